@@ -0,0 +1,131 @@
+#ifndef EDB_BUCKETINDEX_H
+#define EDB_BUCKETINDEX_H
+
+#include "openfhe.h"
+#include "utils/prng/blake2engine.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Client-side bucketized index on the key column (the first equality column).
+//
+// At ingest the data owner hashes every key with a secret keyed PRF (Blake2 seeded with the key
+// and the value) into one of `bucketNum` buckets and the store groups records by bucket. A query
+// names the bucket of its key plus `decoyNum` random other buckets in random order, and the
+// server evaluates rns_eq only on the records of those buckets.
+//
+// Leakage and padding trade-offs:
+//   bucketNum  more buckets, fewer EQs per query, but finer key frequencies in the bucket sizes
+//   decoyNum   hides the real bucket among decoyNum + 1, at decoyNum times the bucket work
+//   pad        fills every bucket with dummy records up to the largest bucket, so bucket sizes
+//              leak nothing, at the cost of the dummy storage and their EQs
+class BucketIndex {
+public:
+    int bucketNum;
+    int decoyNum;
+    bool pad;
+    std::vector<std::vector<int>> members;   // members[b]: store rows of bucket b, dummies included
+    int dummyNum = 0;
+
+    BucketIndex(int bucketNum, int decoyNum, bool pad) : bucketNum(bucketNum), decoyNum(std::min(decoyNum, bucketNum - 1)), pad(pad) {
+        std::random_device rd;
+        for (auto &w : key) {
+            w = rd();
+        }
+        members.assign(bucketNum, {});
+    }
+
+    // Reads `none`, or `bucket B D pad|nopad`.
+    static BucketIndex *fromInput(std::istream &in) {
+        std::string mode;
+        in >> mode;
+        if (mode != "bucket") {
+            return nullptr;
+        }
+        int bucketNum, decoyNum;
+        std::string padMode;
+        in >> bucketNum >> decoyNum >> padMode;
+        return new BucketIndex(std::max(bucketNum, 1), std::max(decoyNum, 0), padMode == "pad");
+    }
+
+    // Keyed PRF of a key given by its residues.
+    template <size_t N>
+    int bucketOf(const std::array<int64_t, N> &residues) const {
+        std::array<uint32_t, 16> seed = {};
+        std::copy(key.begin(), key.end(), seed.begin());
+        uint32_t h = 0;
+        for (size_t q = 0; q < N; q++) {
+            h = h * 1000003u + (uint32_t) residues[q];
+        }
+        seed[key.size()] = h;
+        default_prng::Blake2Engine engine(seed);
+        return engine() % bucketNum;
+    }
+
+    void add(int row, int bucket) {
+        members[bucket].push_back(row);
+    }
+
+    // Number of dummy records each bucket needs so that all buckets are as large as the largest.
+    std::vector<int> paddingNeeded() const {
+        size_t largest = 0;
+        for (const auto &m : members) {
+            largest = std::max(largest, m.size());
+        }
+        std::vector<int> need(bucketNum, 0);
+        if (pad) {
+            for (int b = 0; b < bucketNum; b++) {
+                need[b] = largest - members[b].size();
+            }
+        }
+        return need;
+    }
+
+    // The real bucket and `decoyNum` distinct decoys, shuffled.
+    template <class Rng>
+    std::vector<int> queryBuckets(int real, Rng &rng) const {
+        std::vector<int> others;
+        for (int b = 0; b < bucketNum; b++) {
+            if (b != real) {
+                others.push_back(b);
+            }
+        }
+        std::shuffle(others.begin(), others.end(), rng);
+        std::vector<int> buckets(others.begin(), others.begin() + decoyNum);
+        buckets.push_back(real);
+        std::shuffle(buckets.begin(), buckets.end(), rng);
+        return buckets;
+    }
+
+    std::vector<int> rowsOf(const std::vector<int> &buckets) const {
+        std::vector<int> rows;
+        for (int b : buckets) {
+            rows.insert(rows.end(), members[b].begin(), members[b].end());
+        }
+        std::sort(rows.begin(), rows.end());
+        return rows;
+    }
+
+    void report(int tau, size_t evaluatedRows, int conditionNum, int modulusNum) const {
+        size_t smallest = tau, largest = 0;
+        for (const auto &m : members) {
+            smallest = std::min(smallest, m.size());
+            largest = std::max(largest, m.size());
+        }
+        const double full = (double) tau * conditionNum * modulusNum;
+        const double used = (double) evaluatedRows * conditionNum * modulusNum;
+        std::cout << "Bucket index: " << bucketNum << " buckets of " << smallest << " to " << largest << " records ("
+                  << dummyNum << " dummies), " << decoyNum << " decoys per query" << std::endl
+                  << "EQ evaluations: " << used << " instead of " << full << ", reduction " << (used > 0 ? full / used : 0.0) << "x" << std::endl;
+    }
+
+private:
+    std::array<uint32_t, 8> key;
+};
+
+#endif
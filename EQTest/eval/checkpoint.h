@@ -0,0 +1,205 @@
+#ifndef EDB_CHECKPOINT_H
+#define EDB_CHECKPOINT_H
+
+#include "openfhe.h"
+
+// header files needed for serialization
+#include "ciphertext-ser.h"
+#include "cryptocontext-ser.h"
+#include "key/key-ser.h"
+#include "scheme/bfvrns/bfvrns-ser.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Periodic checkpointing of long-running homomorphic evaluations.
+//
+// A checkpoint directory (which must exist) holds
+//   context<q>.bin, key-public<q>.bin, key-eval-mult<q>.bin
+//                      the contexts and public keys, written once since every ciphertext is bound to them,
+//   state<k>.bin       the ciphertexts saved by the k-th checkpoint,
+//   checkpoint.txt     loop positions, the live state files and the run parameters, rewritten last
+//                      through a rename.
+// A crash in the middle of a checkpoint therefore leaves the previous one intact. The checkpoint
+// directory belongs to the server, so the secret keys the harness decrypts with go to a separate
+// client key directory (which must exist as well) as key-private<q>.bin.
+//
+// A checkpoint is due after `intervalOps` homomorphic operations or `intervalSeconds` seconds,
+// whichever comes first, 0 disables either trigger. Accumulator state replaces the previous
+// checkpoint, while append mode keeps every state file so that results which are produced once
+// and never updated (e.g. the Group matrix) are written exactly once.
+//
+// The state layout depends on the run (record number, columns, batch size, ...), so the caller
+// sets `params` before saving or loading, and a checkpoint written with other parameters is not
+// loaded.
+class Checkpointer {
+public:
+    using T_CP = lbcrypto::Ciphertext<lbcrypto::DCRTPoly>;
+
+    std::string dir;
+    std::string keyDir;
+    double intervalSeconds;
+    int64_t intervalOps;
+    bool resume;
+    std::vector<int64_t> params;
+
+    Checkpointer(const std::string &dir, const std::string &keyDir, double intervalSeconds, int64_t intervalOps, bool resume)
+        : dir(dir), keyDir(keyDir), intervalSeconds(intervalSeconds), intervalOps(intervalOps), resume(resume),
+          opsSinceLast(0), stateNum(0), checkpointNum(0), checkpointTime(0.0),
+          last(std::chrono::steady_clock::now()) {}
+
+    // Reads a configuration like `ckpt ckpt-client 600 0 new` from `in`, or returns nullptr for `none`.
+    static Checkpointer *fromInput(std::istream &in) {
+        std::string dir, keyDir, mode;
+        double seconds;
+        int64_t ops;
+        in >> dir;
+        if (dir == "none") {
+            return nullptr;
+        }
+        in >> keyDir >> seconds >> ops >> mode;
+        return new Checkpointer(dir, keyDir, seconds, ops, mode == "resume");
+    }
+
+    // Counts `ops` finished operations and returns true when a checkpoint is due.
+    bool tick(int64_t ops = 1) {
+        opsSinceLast += ops;
+        if (intervalOps > 0 && opsSinceLast >= intervalOps) {
+            return true;
+        }
+        if (intervalSeconds > 0) {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - last;
+            return elapsed.count() >= intervalSeconds;
+        }
+        return false;
+    }
+
+    void saveContexts(const std::vector<lbcrypto::CryptoContext<lbcrypto::DCRTPoly>> &cc,
+                      const std::vector<lbcrypto::KeyPair<lbcrypto::DCRTPoly>> &keyPair) {
+        using namespace lbcrypto;
+        for (size_t q = 0; q < cc.size(); q++) {
+            const std::string id = std::to_string(q);
+            Serial::SerializeToFile(dir + "/context" + id + ".bin", cc[q], SerType::BINARY);
+            Serial::SerializeToFile(dir + "/key-public" + id + ".bin", keyPair[q].publicKey, SerType::BINARY);
+            Serial::SerializeToFile(keyDir + "/key-private" + id + ".bin", keyPair[q].secretKey, SerType::BINARY);
+            std::ofstream emkeyfile(dir + "/key-eval-mult" + id + ".bin", std::ios::out | std::ios::binary);
+            cc[q]->SerializeEvalMultKey(emkeyfile, SerType::BINARY, keyPair[q].secretKey->GetKeyTag());
+        }
+    }
+
+    bool loadContexts(std::vector<lbcrypto::CryptoContext<lbcrypto::DCRTPoly>> &cc,
+                      std::vector<lbcrypto::KeyPair<lbcrypto::DCRTPoly>> &keyPair) {
+        using namespace lbcrypto;
+        for (size_t q = 0; q < cc.size(); q++) {
+            const std::string id = std::to_string(q);
+            if (!Serial::DeserializeFromFile(dir + "/context" + id + ".bin", cc[q], SerType::BINARY) ||
+                !Serial::DeserializeFromFile(dir + "/key-public" + id + ".bin", keyPair[q].publicKey, SerType::BINARY)) {
+                std::cerr << "Error reading the contexts of checkpoint " << dir << std::endl;
+                return false;
+            }
+            if (!Serial::DeserializeFromFile(keyDir + "/key-private" + id + ".bin", keyPair[q].secretKey, SerType::BINARY)) {
+                std::cerr << "Error reading the secret keys from " << keyDir << std::endl;
+                return false;
+            }
+            std::ifstream emkeyfile(dir + "/key-eval-mult" + id + ".bin", std::ios::in | std::ios::binary);
+            if (!emkeyfile.is_open() || !cc[q]->DeserializeEvalMultKey(emkeyfile, SerType::BINARY)) {
+                std::cerr << "Error reading the eval mult keys of checkpoint " << dir << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void save(const std::vector<int64_t> &position, const std::vector<T_CP> &state, bool append = false) {
+        using namespace lbcrypto;
+        std::chrono::steady_clock::time_point t_before = std::chrono::steady_clock::now();
+
+        const int first = append ? 0 : stateNum;
+        Serial::SerializeToFile(dir + "/state" + std::to_string(stateNum) + ".bin", state, SerType::BINARY);
+        stateNum++;
+
+        std::ofstream manifest(dir + "/checkpoint.tmp");
+        manifest << position.size();
+        for (int64_t p : position) {
+            manifest << " " << p;
+        }
+        manifest << std::endl << first << " " << stateNum << std::endl;
+        manifest << params.size();
+        for (int64_t p : params) {
+            manifest << " " << p;
+        }
+        manifest << std::endl;
+        manifest.close();
+        std::rename((dir + "/checkpoint.tmp").c_str(), (dir + "/checkpoint.txt").c_str());
+        if (!append && first > 0) {
+            std::remove((dir + "/state" + std::to_string(first - 1) + ".bin").c_str());
+        }
+
+        std::chrono::steady_clock::time_point t_after = std::chrono::steady_clock::now();
+        std::chrono::duration<double> time_used = std::chrono::duration_cast<std::chrono::duration<double>>(t_after - t_before);
+        checkpointTime += time_used.count();
+        checkpointNum++;
+        opsSinceLast = 0;
+        last = t_after;
+    }
+
+    // Loads the positions and the live state files of the last checkpoint, in the order they were saved.
+    bool load(std::vector<int64_t> &position, std::vector<std::vector<T_CP>> &states) {
+        using namespace lbcrypto;
+        std::ifstream manifest(dir + "/checkpoint.txt");
+        size_t len;
+        int first;
+        if (!(manifest >> len)) {
+            std::cerr << "No checkpoint found in " << dir << std::endl;
+            return false;
+        }
+        position.assign(len, 0);
+        for (size_t i = 0; i < len; i++) {
+            manifest >> position[i];
+        }
+        manifest >> first >> stateNum;
+        size_t paramNum;
+        std::vector<int64_t> saved;
+        if (manifest >> paramNum) {
+            saved.assign(paramNum, 0);
+            for (size_t i = 0; i < paramNum; i++) {
+                manifest >> saved[i];
+            }
+        }
+        if (!manifest || saved != params) {
+            std::cerr << "Checkpoint " << dir << " was written with other parameters, not resumed" << std::endl;
+            return false;
+        }
+        states.clear();
+        for (int k = first; k < stateNum; k++) {
+            std::vector<T_CP> state;
+            if (!Serial::DeserializeFromFile(dir + "/state" + std::to_string(k) + ".bin", state, SerType::BINARY)) {
+                std::cerr << "Error reading state" << k << ".bin of checkpoint " << dir << std::endl;
+                return false;
+            }
+            states.push_back(state);
+        }
+        last = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    void report(double totalTime) const {
+        std::cout << "checkpoints: " << checkpointNum << ", time used for checkpoints: " << checkpointTime;
+        if (totalTime > 0) {
+            std::cout << " (" << 100.0 * checkpointTime / totalTime << "%)";
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    int64_t opsSinceLast;
+    int stateNum;
+    int checkpointNum;
+    double checkpointTime;
+    std::chrono::steady_clock::time_point last;
+};
+
+#endif
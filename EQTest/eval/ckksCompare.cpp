@@ -0,0 +1,191 @@
+#include "openfhe.h"
+
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+using namespace lbcrypto;
+using T_CP = Ciphertext<DCRTPoly>;
+
+using std::cout;
+using std::cin;
+using std::endl;
+using std::vector;
+
+// Approximate comparison on CKKS slots for fuzzy numeric filters (price > x, |a - b| < eps).
+//
+// Values are scaled into [0, 1), so differences lie in (-1, 1). sign(d) is approximated by a
+// composite of minimax-style odd polynomials of degree 7 (Cheon et al., "Efficient homomorphic
+// comparison methods with optimal complexity"): `gIter` rounds of g, which pulls small |d| away
+// from 0 quickly, then `fIter` rounds of f, which flattens the result towards +-1. More rounds
+// give a sharper step at 4 levels each.
+const vector<double> gCoefficients = {0, 4589.0 / 1024, 0, -16577.0 / 1024, 0, 25614.0 / 1024, 0, -12860.0 / 1024};
+const vector<double> fCoefficients = {0, 35.0 / 16, 0, -35.0 / 16, 0, 21.0 / 16, 0, -5.0 / 16};
+const int levelsPerRound = 4;
+
+CryptoContext<DCRTPoly> ckks;
+KeyPair<DCRTPoly> ckksKeyPair;
+int gIter, fIter;
+
+
+void initCcCKKS(int slots, int scaleModSize);
+T_CP sign(const T_CP &d);
+T_CP greater(const T_CP &a, const T_CP &b);
+T_CP close(const T_CP &a, const T_CP &b, double eps);
+double bfvSlotTime(int64_t modulus);
+
+
+void initCcCKKS(int slots, int scaleModSize) {
+    CCParams<CryptoContextCKKSRNS> parameters;
+    // the rounds of g and f, the step (x + 1) / 2 and the square of |a - b| < eps
+    parameters.SetMultiplicativeDepth(levelsPerRound * (gIter + fIter) + 2);
+    parameters.SetScalingModSize(scaleModSize);
+    parameters.SetBatchSize(slots);
+    ckks = GenCryptoContext(parameters);
+    ckks->Enable(PKE);
+    ckks->Enable(KEYSWITCH);
+    ckks->Enable(LEVELEDSHE);
+    ckks->Enable(ADVANCEDSHE);
+    ckksKeyPair = ckks->KeyGen();
+    ckks->EvalMultKeyGen(ckksKeyPair.secretKey);
+    cout << "CKKS ring dimension " << ckks->GetRingDimension() << ", " << slots << " slots, depth "
+         << levelsPerRound * (gIter + fIter) + 2 << endl;
+}
+
+int main() {
+    cout << "This program evals approximate comparison on CKKS slots against the exact BFV SIMD EQ." << endl
+         << "Please input log2 of the slot number, the rounds of g and f and the scaling modulus size. e.g.: 15 3 2 50" << endl;
+    int logSlots, scaleModSize;
+    cin >> logSlots >> gIter >> fIter >> scaleModSize;
+    cout << "Please input the tolerance eps for the fuzzy equality |a - b| < eps (values are in [0, 1)). e.g.: 0.01" << endl;
+    double eps;
+    cin >> eps;
+    if (logSlots <= 0 || logSlots > 16 || gIter < 0 || fIter < 1) {
+        cout << "incorrect parameter, please retry." << endl;
+        return 0;
+    }
+    const int slots = 1 << logSlots;
+    initCcCKKS(slots, scaleModSize);
+
+    std::default_random_engine dre;
+    dre.seed(time(0));
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    vector<double> v1(slots), v2(slots);
+    for (int i = 0; i < slots; i++) {
+        v1[i] = u(dre);
+        v2[i] = (i & 1) ? v1[i] + (u(dre) - 0.5) * eps : u(dre);
+    }
+    auto ct1 = ckks -> Encrypt(ckksKeyPair.publicKey, ckks -> MakeCKKSPackedPlaintext(v1));
+    auto ct2 = ckks -> Encrypt(ckksKeyPair.publicKey, ckks -> MakeCKKSPackedPlaintext(v2));
+
+    std::chrono::steady_clock::time_point t_gt_before = std::chrono::steady_clock::now();
+    auto gt = greater(ct1, ct2);
+    std::chrono::steady_clock::time_point t_gt_after = std::chrono::steady_clock::now();
+    auto near = close(ct1, ct2, eps);
+    std::chrono::steady_clock::time_point t_close_after = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_gt = std::chrono::duration_cast<std::chrono::duration<double>>(t_gt_after - t_gt_before);
+    std::chrono::duration<double> time_used_for_close = std::chrono::duration_cast<std::chrono::duration<double>>(t_close_after - t_gt_after);
+
+    // Decisions are checked where the inputs are farther from the threshold than the step width,
+    // relative to eps^2 for the close filter since eps^2 - d^2 of a close slot is at most eps^2.
+    Plaintext ptGt, ptClose;
+    ckks -> Decrypt(ckksKeyPair.secretKey, gt, &ptGt);
+    ckks -> Decrypt(ckksKeyPair.secretKey, near, &ptClose);
+    ptGt -> SetLength(slots);
+    ptClose -> SetLength(slots);
+    auto gtValues = ptGt -> GetRealPackedValue();
+    auto closeValues = ptClose -> GetRealPackedValue();
+    const double margin = 1.0 / 256;
+    const double closeMargin = margin * eps * eps;
+    int gtChecked = 0, gtCorrect = 0;
+    int closePositive = 0, truePositive = 0, closeNegative = 0, trueNegative = 0;
+    double maxError = 0.0;
+    for (int i = 0; i < slots; i++) {
+        const double d = v1[i] - v2[i];
+        if (std::abs(d) > margin) {
+            gtChecked++;
+            gtCorrect += (gtValues[i] > 0.5) == (d > 0);
+            maxError = std::max(maxError, std::abs(gtValues[i] - (d > 0)));
+        }
+        if (std::abs(eps * eps - d * d) > closeMargin) {
+            if (std::abs(d) < eps) {
+                closePositive++;
+                truePositive += closeValues[i] > 0.5;
+            } else {
+                closeNegative++;
+                trueNegative += closeValues[i] <= 0.5;
+            }
+        }
+    }
+    cout << "a > b: time " << time_used_for_gt.count() << ", per slot " << time_used_for_gt.count() / slots
+         << ", correct " << gtCorrect << "/" << gtChecked << ", max error " << maxError << endl;
+    cout << "|a - b| < eps: time " << time_used_for_close.count() << ", per slot " << time_used_for_close.count() / slots
+         << ", true positives " << truePositive << "/" << closePositive
+         << ", true negatives " << trueNegative << "/" << closeNegative << endl;
+
+    // The exact BFV path of crtEQTestSIMD: one EQ chain per NTT-friendly CRT modulus.
+    double bfvPerSlot = 0.0;
+    for (int64_t modulus : {65537, 786433}) {
+        bfvPerSlot += bfvSlotTime(modulus);
+    }
+    cout << "BFV SIMD EQ (crtEQTestSIMD, 65537 and 786433): per slot " << bfvPerSlot << endl;
+    return 0;
+}
+
+// Composite polynomial approximation of sign(d) for d in (-1, 1).
+T_CP sign(const T_CP &d) {
+    T_CP x = d;
+    for (int i = 0; i < gIter; i++) {
+        x = ckks -> EvalPoly(x, gCoefficients);
+    }
+    for (int i = 0; i < fIter; i++) {
+        x = ckks -> EvalPoly(x, fCoefficients);
+    }
+    return x;
+}
+
+// About 1 where a > b and 0 where a < b.
+T_CP greater(const T_CP &a, const T_CP &b) {
+    auto s = sign(ckks -> EvalSub(a, b));
+    return ckks -> EvalMult(ckks -> EvalAdd(s, 1.0), 0.5);
+}
+
+// About 1 where |a - b| < eps, as the step of eps^2 - (a - b)^2, which needs no absolute value.
+T_CP close(const T_CP &a, const T_CP &b, double eps) {
+    auto d = ckks -> EvalSub(a, b);
+    auto s = sign(ckks -> EvalSub(eps * eps, ckks -> EvalMult(d, d)));
+    return ckks -> EvalMult(ckks -> EvalAdd(s, 1.0), 0.5);
+}
+
+// Per-slot time of the Fermat EQ chain on a full BFV SIMD ciphertext.
+double bfvSlotTime(int64_t modulus) {
+    CCParams<CryptoContextBFVRNS> parameters;
+    parameters.SetMultiplicativeDepth(floor(log2(modulus)));
+    parameters.SetPlaintextModulus(modulus);
+    CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
+    cc->Enable(PKE);
+    cc->Enable(KEYSWITCH);
+    cc->Enable(LEVELEDSHE);
+    KeyPair<DCRTPoly> keyPair = cc->KeyGen();
+    cc->EvalMultKeyGen(keyPair.secretKey);
+    const int slots = cc->GetRingDimension();
+
+    vector<int64_t> v(slots, 1);
+    auto ct = cc->Encrypt(keyPair.publicKey, cc->MakePackedPlaintext(v));
+    T_CP res;
+    std::chrono::steady_clock::time_point t_before_mul = std::chrono::steady_clock::now();
+    for (int64_t x = modulus - 1; x > 0; x >>= 1)
+    {
+        if (x & 1)
+        {
+            res = res ? cc->EvalMult(ct, res) : ct;
+        }
+        if (x > 1) {
+            ct = cc->EvalMult(ct, ct);
+        }
+    }
+    std::chrono::steady_clock::time_point t_after_mul = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_mul = std::chrono::duration_cast<std::chrono::duration<double>>(t_after_mul - t_before_mul);
+    return time_used_for_mul.count() / slots;
+}
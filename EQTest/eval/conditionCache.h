@@ -0,0 +1,103 @@
+#ifndef EDB_CONDITIONCACHE_H
+#define EDB_CONDITIONCACHE_H
+
+#include "openfhe.h"
+
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Server-side cache of condition masks, the match bits 1 - rns_eq of one condition over every
+// record and modulus.
+//
+// Entries are keyed by an opaque predicate id chosen by the client (the server never learns which
+// column or value it stands for) and by the table version the mask was computed on. Any change
+// to the table bumps the version, so stale masks are never hit and are dropped right away. The
+// least recently used entries are evicted once the masks exceed the memory budget.
+class ConditionCache {
+public:
+    using T_CP = lbcrypto::Ciphertext<lbcrypto::DCRTPoly>;
+    using Key = std::pair<std::string, uint64_t>;
+
+    size_t budgetBytes;
+    size_t usedBytes = 0;
+    size_t hits = 0, misses = 0, evictions = 0;
+
+    explicit ConditionCache(size_t budgetBytes) : budgetBytes(budgetBytes) {}
+
+    // The cached mask of `id` on table version `version`, or nullptr.
+    const std::vector<T_CP> *get(const std::string &id, uint64_t version) {
+        auto it = index.find({id, version});
+        if (it == index.end()) {
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        entries.splice(entries.begin(), entries, it->second);
+        return &it->second->mask;
+    }
+
+    void put(const std::string &id, uint64_t version, const std::vector<T_CP> &mask) {
+        size_t bytes = 0;
+        for (const auto &ct : mask) {
+            bytes += ciphertextBytes(ct);
+        }
+        if (bytes > budgetBytes || index.count({id, version})) {
+            return;
+        }
+        while (usedBytes + bytes > budgetBytes) {
+            evict(std::prev(entries.end()));
+            evictions++;
+        }
+        entries.push_front({{id, version}, mask, bytes});
+        index[{id, version}] = entries.begin();
+        usedBytes += bytes;
+    }
+
+    // Drops every mask computed on a table version before `version`.
+    void invalidateBefore(uint64_t version) {
+        for (auto it = entries.begin(); it != entries.end();) {
+            auto next = std::next(it);
+            if (it->key.second < version) {
+                evict(it);
+            }
+            it = next;
+        }
+    }
+
+    void report() const {
+        std::cout << "Condition cache: " << hits << " hits, " << misses << " misses, " << evictions << " evictions, "
+                  << index.size() << " masks in " << usedBytes << "/" << budgetBytes << " bytes" << std::endl;
+    }
+
+    // In-memory size of the polynomial data, which dominates a ciphertext.
+    static size_t ciphertextBytes(const T_CP &ct) {
+        size_t bytes = 0;
+        for (const auto &element : ct -> GetElements()) {
+            bytes += element.GetNumOfElements() * element.GetRingDimension() * sizeof(uint64_t);
+        }
+        return bytes;
+    }
+
+private:
+    struct Entry {
+        Key key;
+        std::vector<T_CP> mask;
+        size_t bytes;
+    };
+
+    std::list<Entry> entries;   // most recently used first
+    std::map<Key, std::list<Entry>::iterator> index;
+
+    void evict(std::list<Entry>::iterator it) {
+        usedBytes -= it->bytes;
+        index.erase(it->key);
+        entries.erase(it);
+    }
+};
+
+#endif
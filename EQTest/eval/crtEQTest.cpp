@@ -1,4 +1,9 @@
 #include "openfhe.h"
+#include "checkpoint.h"
+#include "threadBudget.h"
+#include "fhewEngine.h"
+#include "digitEqEngine.h"
+#include "enginePlanner.h"
 #include <random>
 #include <chrono>
 #include <cmath>
@@ -13,20 +18,47 @@ using std::vector;
 void run_raw_eq(const int64_t plaintextModulus,
                   const vector<int64_t> compareVector1,
                   const vector<int64_t> compareVector2,
-                  const int batchSize);
+                  const int batchSize,
+                  Checkpointer *ckpt);
              
 void run_rns_lt(const vector<int64_t> rnsModulusVector,
              const vector<int64_t> compareVector1[],
              const vector<int64_t> compareVector2[],
              const int rnsModulusNumber,
              const int batchSize,
-             const int64_t p);
+             const int64_t p,
+             Checkpointer *ckpt);
 
 void run_rns_eq(const vector<int64_t> rnsModulusVector,
              const vector<int64_t> compareVector1[],
              const vector<int64_t> compareVector2[],
              const int rnsModulusNumber,
-             const int batchSize);
+             const int batchSize,
+             ThreadBudget *budget);
+
+void run_digit_eq(const vector<uint64_t> compareVector1,
+             const vector<uint64_t> compareVector2,
+             const int messageSize,
+             const int64_t modulus);
+
+void run_fhew_lt(const vector<int64_t> compareVector1,
+             const vector<int64_t> compareVector2,
+             const int messageSize,
+             const int batchSize,
+             const int threads);
+
+void run_switch_lt(const vector<int64_t> compareVector1,
+             const vector<int64_t> compareVector2,
+             const int messageSize,
+             const int slots);
+
+void run_plan(const EnginePlan &plan,
+             const int messageSize,
+             const std::string predicate,
+             const int batchSize,
+             const int cores,
+             Checkpointer *ckpt,
+             ThreadBudget *budget);
 
 int main()
 {
@@ -35,25 +67,67 @@ int main()
     std::default_random_engine dre;
     dre.seed(time(0));
 
-    std::cout << "This program evaluates the time cost of ciphertext comparison. please input the type of eq to use first. `raw_eq` for raw EQ, and 'rns_eq' for RNS-based EQ." << std::endl;
+    std::cout << "This program evaluates the time cost of ciphertext comparison. please input the type of eq to use first. `raw_eq` for raw EQ, 'rns_eq' for RNS-based EQ and `plan` to let the cost model pick the engine." << std::endl;
     std::string comparisonType;
     std::cin >> comparisonType;
-
-    if (comparisonType == "raw_eq") {
-        std::cout << "For raw EQ, please input the message size, e.g.: for plaintextModulus = 2^16 ≈ 65537, input 16" << std::endl;
+    std::cout << "Please input the checkpoint directory (`none` to disable), the client directory for the secret keys, the checkpoint interval in seconds and in operations (0 disables either) and `new` or `resume`, e.g.: ckpt ckpt-client 600 0 new" << std::endl;
+    Checkpointer *ckpt = Checkpointer::fromInput(std::cin);
+    std::cout << "Please input the thread budget between comparisons and OpenFHE's inner loops for rns_eq: `none`, `auto` (tuned profile of this machine if any) or `tune`" << std::endl;
+    ThreadBudget *budget = ThreadBudget::fromInput(std::cin);
+
+    if (comparisonType == "plan") {
+        std::cout << "Please input the cost table mode (`auto` for the table of this machine, `calibrate` to measure it first), the message size in bits, the predicate (eq/lt), the batch size, the goal (`latency S` for seconds per batch or `throughput R` for comparisons per second) and `dry` to only print the estimates or `run` to run the chosen engine, e.g.: auto 32 eq 4096 throughput 1000 dry" << std::endl;
+        EnginePlanner *planner = EnginePlanner::fromInput(std::cin);
+        int messageSize, comparisons;
+        std::string predicate, goal, runMode;
+        double target;
+        std::cin >> messageSize >> predicate >> comparisons >> goal >> target >> runMode;
+        comparisons = std::max(comparisons, 1);
+        if (!planner) {
+            std::cout << "incorrect parameter, please retry." << std::endl;
+        } else {
+            if (planner->calibrating) {
+                planner->calibrate(8);
+            }
+            // chains and gates spread over the cores only under a thread budget, as rns_eq does
+            const int cores = budget ? ThreadBudget::currentCores() : 1;
+            vector<EnginePlan> plans = planner->estimate(messageSize, predicate, comparisons, cores);
+            const EnginePlan *best = EnginePlanner::pick(plans, goal, comparisons, cores);
+            EnginePlanner::report(plans, best, goal, target, comparisons, cores);
+            if (best && runMode == "run") {
+                run_plan(*best, messageSize, predicate, comparisons, cores, ckpt, budget);
+            }
+        }
+        delete planner;
+    } else if (comparisonType == "raw_eq") {
+        std::cout << "For raw EQ, please input the message size, e.g.: for plaintextModulus = 2^16 ≈ 65537, input 16. Larger messages (20, 24, 32, 56 or 64) are split into 16-bit digits in the slots of one 65537 context." << std::endl;
         int64_t messageSize, plaintextModulus;
         std::cin >> messageSize;
-
+        std::cout << "Please input the number of comparisons, packed into the slots of as few ciphertexts as possible, e.g.: 32768" << std::endl;
+        int comparisons;
+        std::cin >> comparisons;
+        comparisons = std::max(comparisons, 1);
+
+        // A single chain x^(p-1) for p ≈ 2^messageSize needs messageSize squarings, which only
+        // fits for 16 bits, so wider messages go through the digit engine.
+        if (messageSize == 20 || messageSize == 24 || messageSize == 32 || messageSize == 56 || messageSize == 64) {
+            vector<uint64_t> compareVector1;
+            vector<uint64_t> compareVector2;
+            std::uniform_int_distribution<uint64_t> u = std::uniform_int_distribution<uint64_t>(0, messageSize == 64 ? UINT64_MAX : (uint64_t(1) << messageSize) - 1);
+            for (int i = 0; i < comparisons; i++)
+            {
+                uint64_t num1 = u(dre);
+                uint64_t num2 = u(dre);
+                compareVector1.push_back(num1);
+                compareVector2.push_back((i & 1) ? num1 : num2);
+            }
+            run_digit_eq(compareVector1, compareVector2, messageSize, 65537);
+            delete budget;
+            delete ckpt;
+            return 0;
+        }
         if (messageSize == 16) {
             plaintextModulus = 65537;
-        } else if (messageSize == 20) {
-            plaintextModulus = 1048583;
-        } else if (messageSize == 24) {
-            plaintextModulus = 16777259;
-        } else if (messageSize == 32) {
-            plaintextModulus = 4294967311;
-        } else if (messageSize == 56) {
-            plaintextModulus = 72057594037927936;
         } else {
             std::cout << "inappropriate message size, please restart." << std::endl;
             return 0; 
@@ -61,52 +135,41 @@ int main()
 
         vector<int64_t> compareVector1;
         vector<int64_t> compareVector2;
-        std::uniform_int_distribution<int64_t> u = std::uniform_int_distribution<int64_t>(0, plaintextModulus);
+        // centred, as the packed encoding expects
+        std::uniform_int_distribution<int64_t> u = std::uniform_int_distribution<int64_t>(0, plaintextModulus - 1);
 
-        for (int i = 0; i < batchSize; i++)
+        for (int i = 0; i < comparisons; i++)
         {
-            unsigned int num1 = u(dre) - plaintextModulus / 2;
-            unsigned int num2 = u(dre) - plaintextModulus / 2;
+            int64_t num1 = u(dre) - plaintextModulus / 2;
+            int64_t num2 = u(dre) - plaintextModulus / 2;
             compareVector1.push_back(num1);
             compareVector2.push_back((i & 1) ? num1 : num2);
         }
-        run_raw_eq(plaintextModulus, compareVector1, compareVector2, batchSize);
+        run_raw_eq(plaintextModulus, compareVector1, compareVector2, comparisons, ckpt);
     } else if (comparisonType == "rns_eq") {
-        std::cout << "For RNS-based EQ/LT, please input the type(eq/lt), message size and log(ρ), e.g.:eq 16 4" << std::endl;
+        std::cout << "For RNS-based EQ/LT, please input the type(eq/lt, lt_fhew for rns_lt head-to-head with the FHEW bitwise LT, or lt_switch to add the CKKS-to-FHEW scheme-switching LT), message size and log(ρ), e.g.:eq 16 4" << std::endl;
         std::string rtype; 
         int64_t messageSize, rho, plaintextModulus;
         std::cin >> rtype >> messageSize >> rho;
-        vector<int64_t> rnsModulusVector;
+        int gateThreads = 0, switchSlots = 0;
+        if (rtype == "lt_fhew" || rtype == "lt_switch") {
+            std::cout << "Please input the number of FHEW gate threads (0 for all cores)" << std::endl;
+            std::cin >> gateThreads;
+            if (gateThreads <= 0) {
+                gateThreads = ThreadBudget::currentCores();
+            }
+        }
+        if (rtype == "lt_switch") {
+            std::cout << "Please input the number of packed comparisons for scheme switching (a power of two), e.g.: 1024" << std::endl;
+            std::cin >> switchSlots;
+        }
+        vector<int64_t> rnsModulusVector = EnginePlanner::rnsModuli(messageSize, rho);
         if (messageSize == 16) {
             plaintextModulus = 65537;
-            if (rho == 4) {
-        	    int64_t tmp[4] = {13, 17, 19, 23};
-    	    	rnsModulusVector.insert(rnsModulusVector.begin(), tmp, tmp + 4);
-            } else if (rho == 6) {
-                int64_t tmp[3] = {41, 43, 37};
-    	    	rnsModulusVector.insert(rnsModulusVector.begin(), tmp, tmp + 3);
-            }
         } else if (messageSize == 32) {
             plaintextModulus = 4294967311;
-            if (rho == 4) {
-                int64_t tmp[8] = {7, 11, 13, 17, 19, 23, 29, 31};
-                rnsModulusVector.insert(rnsModulusVector.begin(), tmp, tmp + 8);
-            } else if (rho == 6) {
-                int64_t tmp[5] = {73, 79, 83, 89, 97};
-                rnsModulusVector.insert(rnsModulusVector.begin(), tmp, tmp + 5);
-            }
         } else if (messageSize == 64) {
             plaintextModulus = INT64_MAX;
-            if (rho == 4) {
-                int64_t tmp[13] = {7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
-                rnsModulusVector.insert(rnsModulusVector.begin(), tmp, tmp + 13);
-            } else if (rho == 6) {
-                int64_t tmp[11] = {53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101};
-                rnsModulusVector.insert(rnsModulusVector.begin(), tmp, tmp + 11);
-            } else if (rho == 8) {
-                int64_t tmp[8] = {233, 239, 241, 251, 257, 263, 269, 271};
-                rnsModulusVector.insert(rnsModulusVector.begin(), tmp, tmp + 8);
-            }
         }
         
         if (rnsModulusVector.size() <= 0) {
@@ -118,26 +181,27 @@ int main()
 
         vector<int64_t> rnsCompareVector1[len];
         vector<int64_t> rnsCompareVector2[len];
-        std::uniform_int_distribution<int64_t> u = std::uniform_int_distribution<int64_t>(0, plaintextModulus);
+        // messages are drawn from [0, 2^messageSize - 1], the range the RNS moduli were chosen for
+        std::uniform_int_distribution<uint64_t> u = std::uniform_int_distribution<uint64_t>(0, messageSize >= 64 ? UINT64_MAX : (uint64_t(1) << messageSize) - 1);
 
         vector<int64_t> compareVector1;
         vector<int64_t> compareVector2;
 
         for (int i = 0; i < batchSize; i++)
         {
-            unsigned int num1 = u(dre);
-            unsigned int num2 = u(dre);
+            uint64_t num1 = u(dre);
+            uint64_t num2 = (i & 1) ? num1 : u(dre);
             compareVector1.push_back(num1);
-            compareVector2.push_back((i & 1) ? num1 : num2);
+            compareVector2.push_back(num2);
 
             for (int j = 0; j < len; j++)
             {
-                int val_1 = (num1 % (rnsModulusVector[j])) - rnsModulusVector[j] / 2;
-                int val_2 = (num2 % (rnsModulusVector[j])) - rnsModulusVector[j] / 2;
+                int64_t val_1 = (int64_t) (num1 % rnsModulusVector[j]) - rnsModulusVector[j] / 2;
+                int64_t val_2 = (int64_t) (num2 % rnsModulusVector[j]) - rnsModulusVector[j] / 2;
                 
-                if (rtype == "lt") {
-                    val_1 = abs(val_1);
-                    val_2 = abs(val_2);
+                if (rtype != "eq") {
+                    val_1 = std::abs(val_1);
+                    val_2 = std::abs(val_2);
                 }
                 
                 rnsCompareVector1[j].push_back(val_1);
@@ -145,9 +209,15 @@ int main()
             }
         }
         if (rtype == "eq") {
-            run_rns_eq(rnsModulusVector, rnsCompareVector1, rnsCompareVector2, len, batchSize);
+            run_rns_eq(rnsModulusVector, rnsCompareVector1, rnsCompareVector2, len, batchSize, budget);
         } else {
-            run_rns_lt(rnsModulusVector, rnsCompareVector1, rnsCompareVector2, len, batchSize, plaintextModulus);
+            run_rns_lt(rnsModulusVector, rnsCompareVector1, rnsCompareVector2, len, batchSize, plaintextModulus, ckpt);
+        }
+        if (rtype == "lt_fhew" || rtype == "lt_switch") {
+            run_fhew_lt(compareVector1, compareVector2, messageSize, batchSize, gateThreads);
+        }
+        if (rtype == "lt_switch") {
+            run_switch_lt(compareVector1, compareVector2, messageSize, switchSlots);
         }
         
     }
@@ -254,12 +324,15 @@ int main()
     // run_eq_raw(bigPlaintextModulus, compareVector1, compareVector2);
     // run_raw_eq(bigPlaintextModulus, compareVector1, compareVector2, batchSize);
     // run_rns_eq(rnsModulusVector, rnsCompareVector1, rnsCompareVector2, len, batchSize);
+    delete budget;
+    delete ckpt;
 }
 
 void run_raw_eq(const int64_t plaintextModulus,
                   const vector<int64_t> compareVector1,
                   const vector<int64_t> compareVector2,
-                  const int batchSize)
+                  const int batchSize,
+                  Checkpointer *ckpt)
 {
 
     cout << "Start raw_eq" << endl;
@@ -279,70 +352,131 @@ void run_raw_eq(const int64_t plaintextModulus,
 
     double multTime = 0.0;
 
-    CCParams<CryptoContextBFVRNS> parameters;
-    parameters.SetMultiplicativeDepth(16);
-    parameters.SetPlaintextModulus(plaintextModulus);
+    // checkpointed state: the batch index, the remaining exponent and the two chain ciphertexts
+    using T_CP = Ciphertext<DCRTPoly>;
+    vector<CryptoContext<DCRTPoly>> ccs(1);
+    vector<KeyPair<DCRTPoly>> keyPairs(1);
+    vector<int64_t> position;
+    vector<vector<T_CP>> states;
+    if (ckpt) {
+        ckpt->params = {plaintextModulus, batchSize};
+    }
+    const bool resumed = ckpt && ckpt->resume && ckpt->loadContexts(ccs, keyPairs) && ckpt->load(position, states)
+                         && position.size() == 2 && states.size() == 1 && states[0].size() == 2;
+
+    CryptoContext<DCRTPoly> cc;
+    if (resumed) {
+        cc = ccs[0];
+    } else {
+        // the squarings of x^(p-1) and the final multiplication into res
+        CCParams<CryptoContextBFVRNS> parameters;
+        parameters.SetMultiplicativeDepth(floor(log2(plaintextModulus)) + 1);
+        parameters.SetPlaintextModulus(plaintextModulus);
 
-    CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
-    cc->Enable(PKE);
-    cc->Enable(KEYSWITCH);
-    cc->Enable(LEVELEDSHE);
+        cc = GenCryptoContext(parameters);
+        cc->Enable(PKE);
+        cc->Enable(KEYSWITCH);
+        cc->Enable(LEVELEDSHE);
 
-    // cout << "\np = " << cc->GetCryptoParameters()->GetPlaintextModulus() << std::endl;
-    // cout << "m = " << cc->GetCryptoParameters()->GetElementParams()->GetCyclotomicOrder() << std::endl;
-    // std::cout << "log2 q = " << log2(cc->GetCryptoParameters()->GetElementParams()->GetModulus().ConvertToDouble())
-    //           << std::endl;
-    // cout << "SecurityLevel : " << cc -> GetSecurityLevel() << endl;
+        // cout << "\np = " << cc->GetCryptoParameters()->GetPlaintextModulus() << std::endl;
+        // cout << "m = " << cc->GetCryptoParameters()->GetElementParams()->GetCyclotomicOrder() << std::endl;
+        // std::cout << "log2 q = " << log2(cc->GetCryptoParameters()->GetElementParams()->GetModulus().ConvertToDouble())
+        //           << std::endl;
+        // cout << "SecurityLevel : " << cc -> GetSecurityLevel() << endl;
 
-    KeyPair<DCRTPoly> keyPair;
-    keyPair = cc->KeyGen();
-    cout << "KenGen Finished" << endl;
+        keyPairs[0] = cc->KeyGen();
+        cout << "KenGen Finished" << endl;
 
-    cc->EvalMultKeyGen(keyPair.secretKey);
+        cc->EvalMultKeyGen(keyPairs[0].secretKey);
+        if (ckpt) {
+            ckpt->saveContexts({cc}, keyPairs);
+        }
+    }
+    KeyPair<DCRTPoly> keyPair = keyPairs[0];
 
-    for (int i = 0; i < batchSize; i++)
+    // p ≡ 1 mod 2N, so every slot of a packed plaintext is one comparison and a whole batch of
+    // `slots` comparisons shares one chain.
+    const int slots = cc->GetRingDimension();
+    const int batchNum = (batchSize + slots - 1) / slots;
+    cout << "ring dimension " << slots << ", " << batchNum << " packed batches" << endl;
+
+    int start = resumed ? position[0] : 0;
+    if (resumed) {
+        cout << "resumed from batch " << position[0] << ", exponent " << position[1] << endl;
+    }
+    int correct = 0;
+    for (int i = start; i < batchNum; i++)
     {
-        vector<int64_t> v(1);
-        v[0] = compareVector1[i];
-        Plaintext pt1 = cc->MakeCoefPackedPlaintext(v);
+        const int first = i * slots;
+        const int count = std::min(slots, batchSize - first);
+        vector<int64_t> v1(compareVector1.begin() + first, compareVector1.begin() + first + count);
+        vector<int64_t> v2(compareVector2.begin() + first, compareVector2.begin() + first + count);
+        Plaintext pt1 = cc->MakePackedPlaintext(v1);
         auto ct1 = cc->Encrypt(keyPair.publicKey, pt1);
 
-        v[0] = compareVector2[i];
-        Plaintext pt2 = cc->MakeCoefPackedPlaintext(v);
+        Plaintext pt2 = cc->MakePackedPlaintext(v2);
         auto ct2 = cc->Encrypt(keyPair.publicKey, pt2);
 
-        vector<int64_t> vectorOfInts1 = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
-        Plaintext plaintextAllOne = cc->MakeCoefPackedPlaintext(vectorOfInts1);
+        vector<int64_t> vectorOfInts1(count, 1);
+        Plaintext plaintextAllOne = cc->MakePackedPlaintext(vectorOfInts1);
         auto ciphertextAllOne = cc->Encrypt(keyPair.publicKey, plaintextAllOne);
 
         auto cp = cc->EvalSub(ct1, ct2);
 
         auto res = ciphertextAllOne;
+        int64_t x = plaintextModulus - 1;
+        if (resumed && i == start) {
+            x = position[1];
+            res = states[0][0];
+            cp = states[0][1];
+        }
 
         // cout << "Starting mult..." << endl;
         std::chrono::steady_clock::time_point t_before_mul = std::chrono::steady_clock::now();
 
-        for (int x = plaintextModulus - 1; x > 0; x >>= 1)
+        for (; x > 0; x >>= 1)
         {
             if (x & 1)
             {
                 res = cc->EvalMult(cp, res);
             }
-            cp = cc->EvalMult(cp, cp);
+            if (x > 1) {
+                cp = cc->EvalMult(cp, cp);
+            }
+            if (ckpt && ckpt->tick((x & 1) + 1)) {
+                ckpt->save({i, x >> 1}, {res, cp});
+            }
         }
         std::chrono::steady_clock::time_point t_after_mul = std::chrono::steady_clock::now();
         std::chrono::duration<double> time_used_for_mul = std::chrono::duration_cast<std::chrono::duration<double>>(t_after_mul - t_before_mul);
         multTime += time_used_for_mul.count();
         // cout << "mult finished..." << endl;
-    }
-
-    // Decrypt the result of multiplications
-    // Plaintext plaintextMultResult;
-    // cryptoContext->Decrypt(keyPair.secretKey, res, &plaintextMultResult);
 
-    // cout << "Plaintext #res: " << plaintextMultResult << endl;
+        // res is 0 in the equal slots and 1 elsewhere. The resumed batch was encrypted from the
+        // inputs of the interrupted run, which are not checkpointed, so it is not checked.
+        if (resumed && i == start) {
+            continue;
+        }
+        Plaintext plaintextMultResult;
+        cc->Decrypt(keyPair.secretKey, res, &plaintextMultResult);
+        plaintextMultResult->SetLength(count);
+        const auto &bits = plaintextMultResult->GetPackedValue();
+        for (int j = 0; j < count; j++) {
+            correct += bits[j] == (v1[j] != v2[j]);
+        }
+    }
 
+    const int evaluated = batchSize - std::min(batchSize, start * slots);
+    const int checked = resumed ? batchSize - std::min(batchSize, (start + 1) * slots) : evaluated;
     cout << "time used for mul is: " << multTime << endl;
+    cout << "amortized: " << multTime / evaluated << " per comparison, " << evaluated / multTime << " comparisons per second, correct "
+         << correct << "/" << checked << endl;
+    if (resumed && start < batchNum) {
+        cout << "the resumed batch " << start << " is not checked, its inputs are those of the interrupted run" << endl;
+    }
+    if (ckpt) {
+        ckpt->report(multTime);
+    }
 }
 
 
@@ -351,29 +485,97 @@ void run_rns_lt(const vector<int64_t> rnsModulusVector,
              const vector<int64_t> compareVector2[],
              const int rnsModulusNumber,
              const int batchSize,
-             const int64_t p)
+             const int64_t p,
+             Checkpointer *ckpt)
 {
-    vector<int64_t> dif[rnsModulusNumber];
-    vector<int64_t> neg[rnsModulusNumber];
-     
-    for (int i = 0; i < rnsModulusNumber; i++) {
-        for(int b = 0; b < batchSize; b++) {
-            // cout << compareVector1[i][b] - compareVector2[i][b] / 2 << endl;
-            // dif[i].push_back(0);
-            dif[i].push_back( compareVector1[i][b] - compareVector2[i][b] );
-            neg[i].push_back(0);
+    using T_CP = Ciphertext<DCRTPoly>;
+
+    // The contexts are generated once and the EQ results are summed into one accumulator per
+    // modulus and batch, which together with the encrypted differences is the checkpointed state.
+    vector<CryptoContext<DCRTPoly>> ccs(rnsModulusNumber);
+    vector<KeyPair<DCRTPoly>> keyPairs(rnsModulusNumber);
+    vector<T_CP> res(rnsModulusNumber * batchSize);
+    vector<T_CP> dif(rnsModulusNumber * batchSize);
+    int64_t start = -(p - 1) / 2;
+
+    vector<int64_t> position;
+    vector<vector<T_CP>> states;
+    if (ckpt) {
+        ckpt->params = {rnsModulusNumber, batchSize, p};
+        ckpt->params.insert(ckpt->params.end(), rnsModulusVector.begin(), rnsModulusVector.end());
+    }
+    if (ckpt && ckpt->resume && ckpt->loadContexts(ccs, keyPairs) && ckpt->load(position, states)
+        && position.size() == 1 && states.size() == 1 && states[0].size() == (size_t) 2 * rnsModulusNumber * batchSize) {
+        start = position[0];
+        res.assign(states[0].begin(), states[0].begin() + rnsModulusNumber * batchSize);
+        dif.assign(states[0].begin() + rnsModulusNumber * batchSize, states[0].end());
+        cout << "resumed from i = " << start << endl;
+    } else {
+        for (int j = 0; j < rnsModulusNumber; j++) {
+            const int modulus = rnsModulusVector[j];
+            CCParams<CryptoContextBFVRNS> parameters;
+            parameters.SetMultiplicativeDepth(floor(log2(modulus)));
+            parameters.SetPlaintextModulus(modulus);
+            ccs[j] = GenCryptoContext(parameters);
+            ccs[j]->Enable(PKE);
+            ccs[j]->Enable(KEYSWITCH);
+            ccs[j]->Enable(LEVELEDSHE);
+            keyPairs[j] = ccs[j]->KeyGen();
+            ccs[j]->EvalMultKeyGen(keyPairs[j].secretKey);
+
+            vector<int64_t> v(1);
+            for (int b = 0; b < batchSize; b++) {
+                v[0] = compareVector1[j][b] - compareVector2[j][b];
+                dif[j * batchSize + b] = ccs[j]->Encrypt(keyPairs[j].publicKey, ccs[j]->MakeCoefPackedPlaintext(v));
+                v[0] = 0;
+                res[j * batchSize + b] = ccs[j]->Encrypt(keyPairs[j].publicKey, ccs[j]->MakeCoefPackedPlaintext(v));
+            }
+        }
+        if (ckpt) {
+            ckpt->saveContexts(ccs, keyPairs);
         }
     }
 
-    for (int i = -(p-1)/2; i < -1; i++) {
-        cout << i << endl;
+    vector<T_CP> ciphertextAllOne(rnsModulusNumber);
+    vector<int64_t> v = {1};
+    for (int j = 0; j < rnsModulusNumber; j++) {
+        ciphertextAllOne[j] = ccs[j]->Encrypt(keyPairs[j].publicKey, ccs[j]->MakeCoefPackedPlaintext(v));
+    }
+
+    double multTime = 0.0;
+    std::chrono::steady_clock::time_point t_before_mul = std::chrono::steady_clock::now();
+    for (int64_t i = start; i < -1; i++) {
         for (int j = 0; j < rnsModulusNumber; j++) {
+            const int modulus = rnsModulusVector[j];
+            v[0] = std::abs(i % modulus) / 2;
+            Plaintext neg = ccs[j]->MakeCoefPackedPlaintext(v);
             for (int b = 0; b < batchSize; b++) {
-                neg[j][b] = abs( i % rnsModulusVector[j] ) / 2;
+                auto ct = ccs[j]->EvalSub(dif[j * batchSize + b], neg);
+                auto eq = ciphertextAllOne[j];
+                for (int x = modulus - 1; x > 0; x >>= 1)
+                {
+                    if (x & 1)
+                    {
+                        eq = ccs[j]->EvalMult(ct, eq);
+                    }
+                    ct = ccs[j]->EvalMult(ct, ct);
+                }
+                res[j * batchSize + b] = ccs[j]->EvalAdd(res[j * batchSize + b], eq);
             }
         }
-        cout << dif << endl;
-        run_rns_eq(rnsModulusVector, dif, neg, rnsModulusNumber, batchSize);
+        if (ckpt && ckpt->tick(rnsModulusNumber * batchSize)) {
+            vector<T_CP> state(res);
+            state.insert(state.end(), dif.begin(), dif.end());
+            ckpt->save({i + 1}, state);
+            cout << "checkpoint at i = " << i + 1 << endl;
+        }
+    }
+    std::chrono::steady_clock::time_point t_after_mul = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_mul = std::chrono::duration_cast<std::chrono::duration<double>>(t_after_mul - t_before_mul);
+    multTime += time_used_for_mul.count();
+    cout << "total mul time: " << multTime << endl;
+    if (ckpt) {
+        ckpt->report(multTime);
     }
 }
 
@@ -382,7 +584,8 @@ void run_rns_eq(const vector<int64_t> rnsModulusVector,
              const vector<int64_t> compareVector1[],
              const vector<int64_t> compareVector2[],
              const int rnsModulusNumber,
-             const int batchSize)
+             const int batchSize,
+             ThreadBudget *budget)
 {
 
     cout << "starting rns comparation..." << endl;
@@ -419,8 +622,11 @@ void run_rns_eq(const vector<int64_t> rnsModulusVector,
     // for the ans cp
     vector<vector<T_CP>> resVector(rnsModulusNumber, vector<T_CP>(batchSize, 0));
 
-    double multTime = 0.0;
-
+    // Contexts and keys are registered in OpenFHE's global tables, so they are set up serially.
+    // The EQ chains then run under the thread budget, one task per modulus and batch element.
+    vector<CryptoContext<DCRTPoly>> ccs(rnsModulusNumber);
+    vector<T_CP> ciphertextAllOne(rnsModulusNumber);
+    vector<vector<T_CP>> diffVector(rnsModulusNumber, vector<T_CP>(batchSize));
     for (int i = 0; i < rnsModulusNumber; i++)
     {
         const int modulus = rnsModulusVector[i];
@@ -433,10 +639,11 @@ void run_rns_eq(const vector<int64_t> rnsModulusVector,
         cc->Enable(LEVELEDSHE);
         KeyPair<DCRTPoly> keyPair = cc->KeyGen();
         cc->EvalMultKeyGen(keyPair.secretKey);
+        ccs[i] = cc;
 
         vector<int64_t> vectorOfInts1 = {1};
         Plaintext plaintextAllOne = cc->MakeCoefPackedPlaintext(vectorOfInts1);
-        auto ciphertextAllOne = cc->Encrypt(keyPair.publicKey, plaintextAllOne);
+        ciphertextAllOne[i] = cc->Encrypt(keyPair.publicKey, plaintextAllOne);
 
         // i compareVector
         // j nums in compareVector[i]
@@ -451,44 +658,312 @@ void run_rns_eq(const vector<int64_t> rnsModulusVector,
             v[0] = compareVector2[i][j];
             Plaintext pt2 = cc->MakeCoefPackedPlaintext(v);
             auto ct2 = cc->Encrypt(keyPair.publicKey, pt2);
-            auto ct = cc->EvalSub(ct1, ct2);
+            diffVector[i][j] = cc->EvalSub(ct1, ct2);
+        }
 
-            // Plaintext plaintextResult;
-            // cc->Decrypt(keyPair.secretKey, ct, &plaintextResult);
-            // cout << "Plaintext ct1 - ct2: " << plaintextResult << endl;
+        if (budget && budget->tuning && i == rnsModulusNumber - 1)
+        {
+            budget->tune(cc, keyPair.publicKey, floor(log2(modulus)));
+        }
+    }
 
-            auto res = ciphertextAllOne;
+    const int tasks = rnsModulusNumber * batchSize;
+    vector<double> mulTimeVector(tasks, 0.0);
+    if (budget)
+    {
+        budget->report(tasks);
+    }
+    std::chrono::steady_clock::time_point t_before_all = std::chrono::steady_clock::now();
+    parallelFor(budget, tasks, [&](int t)
+    {
+        const int i = t / batchSize;
+        const int j = t % batchSize;
+        const int modulus = rnsModulusVector[i];
+        auto cc = ccs[i];
+        auto ct = diffVector[i][j];
+        auto res = ciphertextAllOne[i];
 
-            // cout << "Starting rns mult, modulus " << i << "\t batch " << j << endl;
-            std::chrono::steady_clock::time_point t_before_mul = std::chrono::steady_clock::now();
+        // cout << "Starting rns mult, modulus " << i << "\t batch " << j << endl;
+        std::chrono::steady_clock::time_point t_before_mul = std::chrono::steady_clock::now();
 
-            for (int x = modulus - 1; x > 0; x >>= 1)
+        for (int x = modulus - 1; x > 0; x >>= 1)
+        {
+            if (x & 1)
             {
-                if (x & 1)
-                {
-                    res = cc->EvalMult(ct, res);
-                }
-                ct = cc->EvalMult(ct, ct);
+                res = cc->EvalMult(ct, res);
             }
+            ct = cc->EvalMult(ct, ct);
+        }
 
-            // cout << "mult finished..." << endl;
-            std::chrono::steady_clock::time_point t_after_mul = std::chrono::steady_clock::now();
+        // cout << "mult finished..." << endl;
+        std::chrono::steady_clock::time_point t_after_mul = std::chrono::steady_clock::now();
 
-            std::chrono::duration<double> time_used_for_mul = std::chrono::duration_cast<std::chrono::duration<double>>(t_after_mul - t_before_mul);
-            multTime += time_used_for_mul.count();
+        std::chrono::duration<double> time_used_for_mul = std::chrono::duration_cast<std::chrono::duration<double>>(t_after_mul - t_before_mul);
+        mulTimeVector[t] = time_used_for_mul.count();
 
-            resVector[i][j] = res;
-        }
+        resVector[i][j] = res;
+    });
+    std::chrono::steady_clock::time_point t_after_all = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_all = std::chrono::duration_cast<std::chrono::duration<double>>(t_after_all - t_before_all);
 
-        // for (int j = 0; j < batchSize; j++)
-        // {
-        //     Plaintext plaintextResult;
-        //     cc->Decrypt(keyPair.secretKey, resVector[i][j], &plaintextResult);
-        //     // cout << "Plaintext #" << j << ": " << plaintextResult << endl;
-        // }
+    double multTime = 0.0;
+    for (double time : mulTimeVector)
+    {
+        multTime += time;
     }
+    cout << "wall time: " << time_used_for_all.count() << endl;
     cout << "total mul time: " << multTime << endl;
+    cout << "amortized: " << time_used_for_all.count() / batchSize << " per comparison, " << batchSize / time_used_for_all.count()
+         << " comparisons per second" << endl;
+}
+
+// Digit-decomposed EQ (see DigitEqEngine): one chain over the digits of all comparisons in the
+// slots, then the rotate-and-multiply AND of each comparison's digits.
+void run_digit_eq(const vector<uint64_t> compareVector1,
+             const vector<uint64_t> compareVector2,
+             const int messageSize,
+             const int64_t modulus)
+{
+    cout << "Start digit_eq" << endl;
+    DigitEqEngine engine(modulus, messageSize);
+    cout << "ring dimension " << engine.slots << ", " << engine.digitNum << " digits of " << engine.digitBits << " bits in "
+         << engine.stride << " slots per comparison, depth " << engine.depth() << ", " << engine.capacity() << " comparisons per ciphertext" << endl;
+
+    const int capacity = engine.capacity();
+    const int total = compareVector1.size();
+    int correct = 0;
+    for (int first = 0; first < total; first += capacity) {
+        const int count = std::min(capacity, total - first);
+        vector<uint64_t> v1(compareVector1.begin() + first, compareVector1.begin() + first + count);
+        vector<uint64_t> v2(compareVector2.begin() + first, compareVector2.begin() + first + count);
+        auto ct1 = engine.encrypt(v1);
+        auto ct2 = engine.encrypt(v2);
+        auto res = engine.eq(ct1, ct2);
+        vector<int64_t> bits = engine.decrypt(res, count);
+        for (int i = 0; i < count; i++) {
+            correct += bits[i] == (v1[i] == v2[i]);
+        }
+    }
+    const double multTime = engine.chainTime + engine.andTime;
+    cout << "time used for digit chain is: " << engine.chainTime << endl;
+    cout << "time used for digit AND is: " << engine.andTime << endl;
+    cout << "amortized: " << multTime / total << " per comparison, " << total / multTime << " comparisons per second, correct "
+         << correct << "/" << total << endl;
 }
 
+// Bitwise LT on the FHEW side: the numbers are encrypted bit by bit and compared by the
+// parallel prefix comparator of FhewEngine, so the order is exact over all messageSize bits.
+void run_fhew_lt(const vector<int64_t> compareVector1,
+             const vector<int64_t> compareVector2,
+             const int messageSize,
+             const int batchSize,
+             const int threads)
+{
+    auto cc = BinFHEContext();
+    cc.GenerateBinFHEContext(STD128);
+    auto sk = cc.KeyGen();
+    cc.BTKeyGen(sk);
+    FhewEngine engine(cc, sk, threads);
+
+    const uint64_t mask = messageSize >= 64 ? UINT64_MAX : (1ULL << messageSize) - 1;
+    vector<vector<LWECiphertext>> ct1(batchSize);
+    vector<vector<LWECiphertext>> ct2(batchSize);
+    for (int b = 0; b < batchSize; b++) {
+        ct1[b] = engine.encryptBits(compareVector1[b] & mask, messageSize);
+        ct2[b] = engine.encryptBits(compareVector2[b] & mask, messageSize);
+    }
+    auto res = engine.lt(ct1, ct2);
+
+    int correct = 0;
+    for (int b = 0; b < batchSize; b++) {
+        correct += engine.decryptBit(res[b]) == ((uint64_t) (compareVector1[b] & mask) < (uint64_t) (compareVector2[b] & mask));
+    }
+    cout << "FHEW " << messageSize << "-bit LT on " << threads << " threads: " << engine.gates << " gates, gate time " << engine.gateTime
+         << ", per comparison " << engine.gateTime / batchSize << ", correct " << correct << "/" << batchSize << endl;
+}
+
+// LT by scheme switching: the numbers stay CKKS-packed, EvalCompareSchemeSwitching extracts the
+// slots of a - b to FHEW, takes their signs there and packs the results back into a CKKS mask,
+// which then selects and sums the values of a homomorphically. The first comparisons are those of
+// compareVector1/2 and the remaining slots are random numbers of the same size.
+//
+// The FHEW large-precision modulus needs room for a - b and the sign bit, logQ = bits + 9, and
+// BinFHE stops at logQ = 29, so one switch compares at most 20 bits. Wider messages are split
+// into limbs of at most 20 bits: each limb gives lt_k and gt_k (the switch with the operands
+// swapped), and from the least significant limb up lt = lt_k + (1 - lt_k - gt_k) * lt, one more
+// level per extra limb.
+void run_switch_lt(const vector<int64_t> compareVector1,
+             const vector<int64_t> compareVector2,
+             const int messageSize,
+             const int slots)
+{
+    const int maxLimbBits = 20;
+    // the masked sum runs on the whole values in CKKS, whose precision stops at 32 bits
+    if (messageSize > 32) {
+        cout << "scheme switching: " << messageSize << "-bit messages exceed the CKKS precision, skipped." << endl;
+        return;
+    }
+    const int limbNum = (messageSize + maxLimbBits - 1) / maxLimbBits;
+    const int limbBits = (messageSize + limbNum - 1) / limbNum;
+    const int logQLWE = limbBits + 9;
+
+    std::chrono::steady_clock::time_point t_setup_before = std::chrono::steady_clock::now();
+    CCParams<CryptoContextCKKSRNS> parameters;
+    // the switch itself, the limb combination, then the mask product and the slot sum
+    parameters.SetMultiplicativeDepth(17 + (limbNum - 1) + 2);
+    parameters.SetScalingModSize(50);
+    parameters.SetFirstModSize(60);
+    parameters.SetScalingTechnique(FLEXIBLEAUTOEXT);
+    parameters.SetSecurityLevel(HEStd_128_classic);
+    parameters.SetBatchSize(slots);
+    parameters.SetSecretKeyDist(UNIFORM_TERNARY);
+    parameters.SetKeySwitchTechnique(HYBRID);
+    parameters.SetNumLargeDigits(3);
+    CryptoContext<DCRTPoly> cc = GenCryptoContext(parameters);
+    cc->Enable(PKE);
+    cc->Enable(KEYSWITCH);
+    cc->Enable(LEVELEDSHE);
+    cc->Enable(ADVANCEDSHE);
+    cc->Enable(SCHEMESWITCH);
+    KeyPair<DCRTPoly> keyPair = cc->KeyGen();
+    cc->EvalMultKeyGen(keyPair.secretKey);
+    cc->EvalSumKeyGen(keyPair.secretKey);
+
+    SchSwchParams switchParams;
+    switchParams.SetSecurityLevelCKKS(HEStd_128_classic);
+    switchParams.SetSecurityLevelFHEW(STD128);
+    switchParams.SetCtxtModSizeFHEWLargePrec(logQLWE);
+    switchParams.SetNumSlotsCKKS(slots);
+    switchParams.SetNumValues(slots);
+    auto skFHEW = cc->EvalSchemeSwitchingSetup(switchParams);
+    auto ccLWE = cc->GetBinCCForSchemeSwitch();
+    ccLWE->BTKeyGen(skFHEW);
+    cc->EvalSchemeSwitchingKeyGen(keyPair, skFHEW);
+    const uint64_t pLWE = (1ULL << logQLWE) / (2 * ccLWE->GetBeta().ConvertToInt());
+    cc->EvalCompareSwitchPrecompute(pLWE, 1.0);
+    std::chrono::steady_clock::time_point t_setup_after = std::chrono::steady_clock::now();
+
+    std::default_random_engine dre;
+    dre.seed(time(0));
+    std::uniform_int_distribution<int64_t> u(0, (1LL << messageSize) - 1);
+    vector<double> v1(slots), v2(slots);
+    for (int i = 0; i < slots; i++) {
+        const bool given = i < (int) compareVector1.size();
+        v1[i] = given ? compareVector1[i] & ((1LL << messageSize) - 1) : u(dre);
+        v2[i] = given ? compareVector2[i] & ((1LL << messageSize) - 1) : u(dre);
+    }
+    auto ct1 = cc->Encrypt(keyPair.publicKey, cc->MakeCKKSPackedPlaintext(v1));
+    vector<Ciphertext<DCRTPoly>> limb1(limbNum), limb2(limbNum);
+    for (int k = 0; k < limbNum; k++) {
+        vector<double> l1(slots), l2(slots);
+        for (int i = 0; i < slots; i++) {
+            l1[i] = ((int64_t) v1[i] >> (k * limbBits)) & ((1LL << limbBits) - 1);
+            l2[i] = ((int64_t) v2[i] >> (k * limbBits)) & ((1LL << limbBits) - 1);
+        }
+        limb1[k] = cc->Encrypt(keyPair.publicKey, cc->MakeCKKSPackedPlaintext(l1));
+        limb2[k] = cc->Encrypt(keyPair.publicKey, cc->MakeCKKSPackedPlaintext(l2));
+    }
+
+    std::chrono::steady_clock::time_point t_cmp_before = std::chrono::steady_clock::now();
+    auto mask = cc->EvalCompareSchemeSwitching(limb1[0], limb2[0], slots, slots);
+    for (int k = 1; k < limbNum; k++) {
+        auto lt = cc->EvalCompareSchemeSwitching(limb1[k], limb2[k], slots, slots);
+        auto gt = cc->EvalCompareSchemeSwitching(limb2[k], limb1[k], slots, slots);
+        auto eq = cc->EvalSub(1.0, cc->EvalAdd(lt, gt));
+        mask = cc->EvalAdd(lt, cc->EvalMult(eq, mask));
+    }
+    std::chrono::steady_clock::time_point t_cmp_after = std::chrono::steady_clock::now();
+    auto selected = cc->EvalSum(cc->EvalMult(mask, ct1), slots);
+    std::chrono::steady_clock::time_point t_aggr_after = std::chrono::steady_clock::now();
+
+    Plaintext ptMask, ptSum;
+    cc->Decrypt(keyPair.secretKey, mask, &ptMask);
+    cc->Decrypt(keyPair.secretKey, selected, &ptSum);
+    ptMask->SetLength(slots);
+    ptSum->SetLength(1);
+    auto maskValues = ptMask->GetRealPackedValue();
+    int correct = 0;
+    double expectedSum = 0.0;
+    for (int i = 0; i < slots; i++) {
+        correct += (maskValues[i] > 0.5) == (v1[i] < v2[i]);
+        expectedSum += v1[i] < v2[i] ? v1[i] : 0.0;
+    }
+
+    std::chrono::duration<double> time_used_for_setup = std::chrono::duration_cast<std::chrono::duration<double>>(t_setup_after - t_setup_before);
+    std::chrono::duration<double> time_used_for_cmp = std::chrono::duration_cast<std::chrono::duration<double>>(t_cmp_after - t_cmp_before);
+    std::chrono::duration<double> time_used_for_aggr = std::chrono::duration_cast<std::chrono::duration<double>>(t_aggr_after - t_cmp_after);
+    cout << "Scheme-switching " << messageSize << "-bit LT (" << limbNum << " limb(s) of " << limbBits << " bits, "
+         << 2 * limbNum - 1 << " switch(es)) on " << slots << " slots: setup time " << time_used_for_setup.count()
+         << ", compare time " << time_used_for_cmp.count() << ", per comparison " << time_used_for_cmp.count() / slots
+         << ", correct " << correct << "/" << slots << endl;
+    cout << "Masked sum time " << time_used_for_aggr.count() << ", sum " << ptSum->GetRealPackedValue()[0] << ", expected " << expectedSum << endl;
+}
 
+// Runs the planner's engine on `batchSize` random pairs of `messageSize` bits, every other pair
+// equal. simd and the FHEW EQ live in crtEQTestSIMD and floatNumberCompareInBits.
+void run_plan(const EnginePlan &plan,
+             const int messageSize,
+             const std::string predicate,
+             const int batchSize,
+             const int cores,
+             Checkpointer *ckpt,
+             ThreadBudget *budget)
+{
+    std::default_random_engine dre;
+    dre.seed(time(0));
+    const uint64_t mask = messageSize >= 64 ? UINT64_MAX : (uint64_t(1) << messageSize) - 1;
+    std::uniform_int_distribution<uint64_t> u = std::uniform_int_distribution<uint64_t>(0, mask);
+    vector<uint64_t> compareVector1;
+    vector<uint64_t> compareVector2;
+    for (int i = 0; i < batchSize; i++)
+    {
+        uint64_t num1 = u(dre);
+        uint64_t num2 = u(dre);
+        compareVector1.push_back(num1);
+        compareVector2.push_back((i & 1) ? num1 : num2);
+    }
 
+    if (plan.engine == "raw") {
+        // centred, as the packed encoding expects
+        vector<int64_t> v1, v2;
+        for (int i = 0; i < batchSize; i++) {
+            v1.push_back((int64_t) compareVector1[i] - 65537 / 2);
+            v2.push_back((int64_t) compareVector2[i] - 65537 / 2);
+        }
+        run_raw_eq(65537, v1, v2, batchSize, ckpt);
+    } else if (plan.engine == "digit") {
+        run_digit_eq(compareVector1, compareVector2, messageSize, 65537);
+    } else if (plan.engine == "rns") {
+        const int rnsBits = EnginePlanner::rnsWidth(messageSize);
+        const vector<int64_t> rnsModulusVector = EnginePlanner::rnsModuli(rnsBits, plan.rho);
+        const int len = rnsModulusVector.size();
+        vector<int64_t> rnsCompareVector1[len];
+        vector<int64_t> rnsCompareVector2[len];
+        for (int i = 0; i < batchSize; i++)
+        {
+            for (int j = 0; j < len; j++)
+            {
+                int val_1 = (compareVector1[i] % (rnsModulusVector[j])) - rnsModulusVector[j] / 2;
+                int val_2 = (compareVector2[i] % (rnsModulusVector[j])) - rnsModulusVector[j] / 2;
+                if (predicate != "eq") {
+                    val_1 = abs(val_1);
+                    val_2 = abs(val_2);
+                }
+                rnsCompareVector1[j].push_back(val_1);
+                rnsCompareVector2[j].push_back(val_2);
+            }
+        }
+        if (predicate == "eq") {
+            run_rns_eq(rnsModulusVector, rnsCompareVector1, rnsCompareVector2, len, batchSize, budget);
+        } else {
+            const int64_t plaintextModulus = rnsBits == 16 ? 65537 : rnsBits == 32 ? 4294967311 : INT64_MAX;
+            run_rns_lt(rnsModulusVector, rnsCompareVector1, rnsCompareVector2, len, batchSize, plaintextModulus, ckpt);
+        }
+    } else if (plan.engine == "fhew" && predicate == "lt") {
+        vector<int64_t> v1(compareVector1.begin(), compareVector1.end());
+        vector<int64_t> v2(compareVector2.begin(), compareVector2.end());
+        run_fhew_lt(v1, v2, messageSize, batchSize, cores);
+    } else {
+        cout << "The " << plan.name() << " engine runs in " << (plan.engine == "simd" ? "crtEQTestSIMD" : "floatNumberCompareInBits") << "." << endl;
+    }
+}
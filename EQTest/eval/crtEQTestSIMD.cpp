@@ -1,5 +1,6 @@
 
 #include "openfhe.h"
+#include "threadBudget.h"
 #include <random>
 #include <chrono>
 #include <cmath>
@@ -11,6 +12,8 @@ using std::cout;
 using std::endl;
 using std::vector;
 
+// Splits the cores between the per-modulus EQ chains and OpenFHE's inner loops, nullptr for serial.
+ThreadBudget *budget = nullptr;
 
 void run_crt(const int64_t crtModulusVector[],
              const vector<int64_t> compareVector1[],
@@ -173,7 +176,10 @@ void test64()
 }
 
 int main() {
+    std::cout << "Please input the thread budget between moduli and OpenFHE's inner loops: `none`, `auto` (tuned profile of this machine if any) or `tune`" << std::endl;
+    budget = ThreadBudget::fromInput(std::cin);
     test64();
+    delete budget;
 }
 
 void run_crt(const int64_t crtModulusVector[],
@@ -224,6 +230,12 @@ void run_crt(const int64_t crtModulusVector[],
         vectorOfInts1.push_back(1);
     }
     
+    // Contexts and keys are registered in OpenFHE's global tables, so they are set up serially.
+    // The EQ chains then run under the thread budget, one task per modulus.
+    vector<CryptoContext<DCRTPoly>> ccs(crtModulusNumber);
+    vector<KeyPair<DCRTPoly>> keyPairs(crtModulusNumber);
+    vector<T_CP> ciphertextAllOne(crtModulusNumber);
+    vector<T_CP> diffVector(crtModulusNumber);
     for (int i = 0; i < crtModulusNumber; i++)
     {
         const int64_t modulus = crtModulusVector[i];
@@ -243,8 +255,10 @@ void run_crt(const int64_t crtModulusVector[],
     std::cout << "log2 q = "
               << log2(cc->GetCryptoParameters()->GetElementParams()->GetModulus().ConvertToDouble())
               << std::endl;
+        ccs[i] = cc;
+        keyPairs[i] = keyPair;
         Plaintext plaintextAllOne = cc->MakePackedPlaintext(vectorOfInts1);
-        auto ciphertextAllOne = cc->Encrypt(keyPair.publicKey, plaintextAllOne);
+        ciphertextAllOne[i] = cc->Encrypt(keyPair.publicKey, plaintextAllOne);
 
         // i compareVector
         // j nums in compareVector[i]
@@ -260,14 +274,31 @@ void run_crt(const int64_t crtModulusVector[],
 
         Plaintext pt2 = cc->MakePackedPlaintext(v2);
         auto ct2 = cc->Encrypt(keyPair.publicKey, pt2);
-        auto ct = cc->EvalSub(ct1, ct2);
+        diffVector[i] = cc->EvalSub(ct1, ct2);
+
+        if (budget && budget->tuning && i == crtModulusNumber - 1)
+        {
+            budget->tune(cc, keyPair.publicKey, floor(log2(modulus)));
+        }
+    }
+
+    vector<double> mulTimeVector(crtModulusNumber, 0.0);
+    if (budget)
+    {
+        budget->report(crtModulusNumber);
+    }
+    std::chrono::steady_clock::time_point t_before_all = std::chrono::steady_clock::now();
+    parallelFor(budget, crtModulusNumber, [&](int i)
+    {
+        const int64_t modulus = crtModulusVector[i];
+        auto cc = ccs[i];
+        auto ct = diffVector[i];
+        auto res = ciphertextAllOne[i];
 
         Plaintext plaintextResult;
-        cc->Decrypt(keyPair.secretKey, ct, &plaintextResult);
+        cc->Decrypt(keyPairs[i].secretKey, ct, &plaintextResult);
         // cout << "Plaintext ct1 - ct2: " << plaintextResult << endl;
 
-        auto res = ciphertextAllOne;
-
         // cout << "Starting CRT mult, modulus " << i << "\t batch " << j << endl;
         std::chrono::steady_clock::time_point t_before_mul = std::chrono::steady_clock::now();
 
@@ -276,7 +307,7 @@ void run_crt(const int64_t crtModulusVector[],
             if (x & 1)
             {
                 res = cc->EvalMult(ct, res);
-                cc->Decrypt(keyPair.secretKey, res, &plaintextResult);
+                cc->Decrypt(keyPairs[i].secretKey, res, &plaintextResult);
                 // cout << "Plaintext of modulus :" << modulus << "#" << ": " << plaintextResult << endl;
             }
             ct = cc->EvalMult(ct, ct);
@@ -286,13 +317,21 @@ void run_crt(const int64_t crtModulusVector[],
         std::chrono::steady_clock::time_point t_after_mul = std::chrono::steady_clock::now();
 
         std::chrono::duration<double> time_used_for_mul = std::chrono::duration_cast<std::chrono::duration<double>>(t_after_mul - t_before_mul);
-        multTime += time_used_for_mul.count();
+        mulTimeVector[i] = time_used_for_mul.count();
 
         resVector[i] = res;
 
         // Plaintext plaintextResult;
         // cc->Decrypt(keyPair.secretKey, resVector[i], &plaintextResult);
         // cout << "Plaintext #" << ": " << plaintextResult << endl;
+    });
+    std::chrono::steady_clock::time_point t_after_all = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_all = std::chrono::duration_cast<std::chrono::duration<double>>(t_after_all - t_before_all);
+
+    for (double time : mulTimeVector)
+    {
+        multTime += time;
     }
+    cout << "wall time: " << time_used_for_all.count() << endl;
     cout << "total mul time: " << multTime << endl;
 }
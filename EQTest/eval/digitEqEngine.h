@@ -0,0 +1,127 @@
+#ifndef EDB_DIGITEQENGINE_H
+#define EDB_DIGITEQENGINE_H
+
+#include "openfhe.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Equality of messages wider than one plaintext modulus allows, on one small NTT-friendly
+// BFV context (e.g. 65537).
+//
+// A message is split into base-2^digitBits digits, 2^digitBits <= p, and comparison k takes
+// slots [k * stride, (k + 1) * stride) with stride = digitNum rounded up to a power of two, the
+// unused digits equal on both sides. One Fermat chain (1 - (a - b)^(p-1)) gives every digit's
+// EQ at once, and log2(stride) rotate-and-multiply levels AND the digits of each comparison into
+// its first slot. Depth is log2(p) + 1 + log2(stride) instead of the log2 of a message-sized
+// modulus, e.g. 19 for 64-bit messages against 64 squarings of a raw chain.
+class DigitEqEngine {
+public:
+    using T_CP = lbcrypto::Ciphertext<lbcrypto::DCRTPoly>;
+
+    lbcrypto::CryptoContext<lbcrypto::DCRTPoly> cc;
+    lbcrypto::KeyPair<lbcrypto::DCRTPoly> keyPair;
+    int64_t modulus;
+    int messageBits;
+    int digitBits;
+    int digitNum;
+    int stride;
+    int slots;
+    double chainTime = 0.0;   // accumulated by eq
+    double andTime = 0.0;
+    lbcrypto::Plaintext ones;
+
+    DigitEqEngine(int64_t modulus, int messageBits) : modulus(modulus), messageBits(messageBits) {
+        digitBits = std::min((int) floor(log2(modulus)), messageBits);
+        digitNum = (messageBits + digitBits - 1) / digitBits;
+        stride = 1;
+        while (stride < digitNum) {
+            stride <<= 1;
+        }
+        lbcrypto::CCParams<lbcrypto::CryptoContextBFVRNS> parameters;
+        parameters.SetMultiplicativeDepth(depth());
+        parameters.SetPlaintextModulus(modulus);
+        cc = lbcrypto::GenCryptoContext(parameters);
+        cc->Enable(lbcrypto::PKE);
+        cc->Enable(lbcrypto::KEYSWITCH);
+        cc->Enable(lbcrypto::LEVELEDSHE);
+        keyPair = cc->KeyGen();
+        cc->EvalMultKeyGen(keyPair.secretKey);
+        std::vector<int32_t> rotations;
+        for (int s = 1; s < stride; s <<= 1) {
+            rotations.push_back(s);
+        }
+        if (!rotations.empty()) {
+            cc->EvalRotateKeyGen(keyPair.secretKey, rotations);
+        }
+        slots = cc->GetRingDimension();
+        ones = cc->MakePackedPlaintext(std::vector<int64_t>(slots, 1));
+    }
+
+    int depth() const {
+        return (int) floor(log2(modulus)) + 1 + (int) log2(stride);
+    }
+
+    // Comparisons per ciphertext.
+    int capacity() const {
+        return slots / stride;
+    }
+
+    // Packs the digits of values[k], centred around 0 for the packed encoding, from slot k * stride.
+    T_CP encrypt(const std::vector<uint64_t> &values) const {
+        std::vector<int64_t> v(slots, 0);
+        const uint64_t mask = digitBits >= 64 ? UINT64_MAX : (uint64_t(1) << digitBits) - 1;
+        const int64_t centre = int64_t(1) << (digitBits - 1);
+        for (size_t k = 0; k < values.size() && (int) k < capacity(); k++) {
+            for (int d = 0; d < digitNum; d++) {
+                const int shift = d * digitBits;
+                v[k * stride + d] = (int64_t) (shift < 64 ? (values[k] >> shift) & mask : 0) - centre;
+            }
+            for (int d = digitNum; d < stride; d++) {
+                v[k * stride + d] = -centre;
+            }
+        }
+        return cc->Encrypt(keyPair.publicKey, cc->MakePackedPlaintext(v));
+    }
+
+    // 1 in slot k * stride where comparison k is equal, 0 where it is not.
+    T_CP eq(const T_CP &a, const T_CP &b) {
+        std::chrono::steady_clock::time_point t_before_chain = std::chrono::steady_clock::now();
+        auto ct = cc->EvalSub(a, b);
+        T_CP res;
+        for (int64_t x = modulus - 1; x > 0; x >>= 1) {
+            if (x & 1) {
+                res = res ? cc->EvalMult(ct, res) : ct;
+            }
+            if (x > 1) {
+                ct = cc->EvalMult(ct, ct);
+            }
+        }
+        res = cc->EvalSub(ones, res);
+        std::chrono::steady_clock::time_point t_before_and = std::chrono::steady_clock::now();
+        for (int s = 1; s < stride; s <<= 1) {
+            res = cc->EvalMult(res, cc->EvalRotate(res, s));
+        }
+        std::chrono::steady_clock::time_point t_after_and = std::chrono::steady_clock::now();
+        chainTime += std::chrono::duration_cast<std::chrono::duration<double>>(t_before_and - t_before_chain).count();
+        andTime += std::chrono::duration_cast<std::chrono::duration<double>>(t_after_and - t_before_and).count();
+        return res;
+    }
+
+    std::vector<int64_t> decrypt(const T_CP &ct, int count) const {
+        lbcrypto::Plaintext pt;
+        cc->Decrypt(keyPair.secretKey, ct, &pt);
+        pt->SetLength(slots);
+        const auto &v = pt->GetPackedValue();
+        std::vector<int64_t> res(count);
+        for (int k = 0; k < count; k++) {
+            res[k] = v[k * stride];
+        }
+        return res;
+    }
+};
+
+#endif
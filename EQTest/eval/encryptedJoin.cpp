@@ -0,0 +1,294 @@
+#include "openfhe.h"
+#include "threadBudget.h"
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+using namespace lbcrypto;
+using T_CP = Ciphertext<DCRTPoly>;
+
+using std::cout;
+using std::cin;
+using std::endl;
+using std::string;
+using std::vector;
+
+// SIMD packing needs p = 1 mod 2n, so the join uses the NTT-friendly CRT moduli of crtEQTestSIMD.
+// Two keys below 2^32 are equal iff they are equal under both moduli.
+const int crtModulusNumber = 2;
+const vector<int64_t> crtModulusVector = {65537, 786433};
+CryptoContext<DCRTPoly> cc[crtModulusNumber];
+KeyPair<DCRTPoly> keyPair[crtModulusNumber];
+int slots;
+
+// Equi-join of A (m rows) and B (n rows) on their key columns.
+//
+// Both tables are packed with period R = 2^ceil(log2(max(m, n))): slot s holds row s mod R, so
+// the slots form T = slots / R blocks and a rotation by r shifts every block cyclically by r
+// (rotations act on each half of the slots, which R divides). Offset r pairs row a of A with row
+// (a + r) mod R of B, so the R offsets cover all m * n pairs. Group g gives block t the copy of B
+// rotated by g * T + t, so one EQ chain tests T offsets at once and the join takes
+// G = ceil(R / T) chains per modulus, about m * n / slots, instead of m * n.
+int R, T, G;
+
+
+bool initCcSIMD(int R);
+int64_t centered(int64_t val, int64_t modulus);
+T_CP encryptPeriodic(const vector<int64_t> &column, int q);
+T_CP rotateBy(const T_CP &ct, int r, int q);
+T_CP eqChain(const T_CP &op1, const T_CP &op2, int q);
+
+
+bool initCcSIMD(int R) {
+    vector<int32_t> indices;
+    for (int k = 1; k < R; k <<= 1) {
+        indices.push_back(k);
+    }
+    for (int i = 0; i < crtModulusNumber; i++) {
+        const int64_t modulus = crtModulusVector[i];
+        CCParams<CryptoContextBFVRNS> parameters;
+        // the chain, the block masks of the rotated copies and the payload product
+        parameters.SetMultiplicativeDepth(ceil(log2(modulus)) + 2);
+        parameters.SetPlaintextModulus(modulus);
+        cc[i] = GenCryptoContext(parameters);
+        cc[i]->Enable(PKE);
+        cc[i]->Enable(KEYSWITCH);
+        cc[i]->Enable(LEVELEDSHE);
+        keyPair[i] = cc[i]->KeyGen();
+        cc[i]->EvalMultKeyGen(keyPair[i].secretKey);
+        // power-of-two rotations, any offset below R is composed from them
+        cc[i]->EvalRotateKeyGen(keyPair[i].secretKey, indices);
+    }
+    // every context must give the same slot count, the packed layout is shared by all moduli
+    slots = cc[0]->GetRingDimension();
+    for (int i = 1; i < crtModulusNumber; i++) {
+        if ((int) cc[i]->GetRingDimension() != slots) {
+            cout << "Ring dimension " << cc[i]->GetRingDimension() << " of modulus " << i << " differs from " << slots
+                 << " of modulus 0, the packed layout needs one slot count." << endl;
+            return false;
+        }
+    }
+    cout << "CryptoContext and KeyPair generatation is done, " << slots << " slots per ciphertext." << endl;
+    return true;
+}
+
+int main() {
+    cout << "This program evals an encrypted equi-join of two tables on their key columns." << endl
+         << "Please input the row numbers of A and B and the key domain size (smaller means more matches). e.g.: 256 256 64" << endl;
+    int m, n;
+    int64_t keyDomain;
+    cin >> m >> n >> keyDomain;
+    cout << "Please input the thread budget over rotation offsets: `none`, `auto` (tuned profile of this machine if any) or `tune`" << endl;
+    ThreadBudget *budget = ThreadBudget::fromInput(cin);
+
+    R = 1;
+    while (R < std::max(m, n)) {
+        R <<= 1;
+    }
+    if (!initCcSIMD(R)) {
+        delete budget;
+        return 0;
+    }
+    if (m <= 0 || n <= 0 || keyDomain <= 0 || R > slots / 2) {
+        cout << "both tables must fit into half of the " << slots << " slots, please retry." << endl;
+        delete budget;
+        return 0;
+    }
+    T = slots / R;
+    G = (R + T - 1) / T;
+    if (budget && budget -> tuning) {
+        budget -> tune(cc[0], keyPair[0].publicKey, floor(log2(crtModulusVector[0])));
+    }
+
+    std::default_random_engine dre;
+    dre.seed(time(0));
+    std::uniform_int_distribution<int64_t> uKey = std::uniform_int_distribution<int64_t>(0, keyDomain - 1);
+    std::uniform_int_distribution<int64_t> uPayload = std::uniform_int_distribution<int64_t>(0, UINT32_MAX);
+    vector<int64_t> keyA(m), payloadA(m), keyB(n), payloadB(n);
+    for (int a = 0; a < m; a++) {
+        keyA[a] = uKey(dre);
+        payloadA[a] = uPayload(dre);
+    }
+    for (int b = 0; b < n; b++) {
+        keyB[b] = uKey(dre);
+        payloadB[b] = uPayload(dre);
+    }
+
+    T_CP ctKeyA[crtModulusNumber], ctPayloadA[crtModulusNumber], ctKeyB[crtModulusNumber], ctPayloadB[crtModulusNumber];
+    for (int q = 0; q < crtModulusNumber; q++) {
+        ctKeyA[q] = encryptPeriodic(keyA, q);
+        ctPayloadA[q] = encryptPeriodic(payloadA, q);
+        ctKeyB[q] = encryptPeriodic(keyB, q);
+        ctPayloadB[q] = encryptPeriodic(payloadB, q);
+    }
+    cout << "Data generation and encryption is done, R = " << R << ", " << T << " offsets per chain, " << G << " chain(s) per modulus." << endl;
+
+    // valid[g][q]: 1 in the slots of block t whose pair (a, (a + g * T + t) mod R) has a < m, b < n
+    // and an offset below R, so padding rows never join. Only the first min(T, R) blocks ever
+    // receive an offset, so only they get a block mask.
+    const int usedBlocks = std::min(T, R);
+    vector<vector<Plaintext>> valid(G, vector<Plaintext>(crtModulusNumber));
+    vector<vector<Plaintext>> blockMask(usedBlocks, vector<Plaintext>(crtModulusNumber));
+    for (int g = 0; g < G; g++) {
+        vector<int64_t> v(slots, 0);
+        for (int s = 0; s < slots; s++) {
+            const int a = s % R, r = g * T + s / R, b = (a + r) % R;
+            v[s] = r < R && a < m && b < n;
+        }
+        for (int q = 0; q < crtModulusNumber; q++) {
+            valid[g][q] = cc[q] -> MakePackedPlaintext(v);
+        }
+    }
+    for (int t = 0; t < usedBlocks; t++) {
+        vector<int64_t> v(slots, 0);
+        for (int s = t * R; s < (t + 1) * R; s++) {
+            v[s] = 1;
+        }
+        for (int q = 0; q < crtModulusNumber; q++) {
+            blockMask[t][q] = cc[q] -> MakePackedPlaintext(v);
+        }
+    }
+
+    // The rotation offsets of each group and modulus are split into chunks, so that there are
+    // about as many tasks as cores even when G is small. A chunk starts from its own rotation of
+    // B and packs its blocks into a partial sum, then one task per group and modulus adds the
+    // partial sums and runs the chain.
+    const int chunkNum = std::max(1, std::min(usedBlocks, ThreadBudget::currentCores() / (G * crtModulusNumber)));
+    const int chunkSize = (usedBlocks + chunkNum - 1) / chunkNum;
+    vector<T_CP> keyPart(G * crtModulusNumber * chunkNum), payloadPart(G * crtModulusNumber * chunkNum);
+    vector<vector<T_CP>> match(G, vector<T_CP>(crtModulusNumber));
+    vector<vector<T_CP>> joinedA(G, vector<T_CP>(crtModulusNumber)), joinedB(G, vector<T_CP>(crtModulusNumber));
+    std::chrono::steady_clock::time_point t_join_before = std::chrono::steady_clock::now();
+    parallelFor(budget, G * crtModulusNumber * chunkNum, [&](int task) {
+        const int g = task / (crtModulusNumber * chunkNum), q = task / chunkNum % crtModulusNumber, c = task % chunkNum;
+        const int first = c * chunkSize;
+        if (first >= usedBlocks || g * T + first >= R) {
+            return;
+        }
+        T_CP keyRot = rotateBy(ctKeyB[q], g * T + first, q);
+        T_CP payloadRot = rotateBy(ctPayloadB[q], g * T + first, q);
+        T_CP keyPacked, payloadPacked;
+        for (int t = first; t < std::min(first + chunkSize, usedBlocks) && g * T + t < R; t++) {
+            if (t > first) {
+                keyRot = cc[q] -> EvalRotate(keyRot, 1);
+                payloadRot = cc[q] -> EvalRotate(payloadRot, 1);
+            }
+            auto k = cc[q] -> EvalMult(keyRot, blockMask[t][q]);
+            auto p = cc[q] -> EvalMult(payloadRot, blockMask[t][q]);
+            keyPacked = keyPacked ? cc[q] -> EvalAdd(keyPacked, k) : k;
+            payloadPacked = payloadPacked ? cc[q] -> EvalAdd(payloadPacked, p) : p;
+        }
+        keyPart[task] = keyPacked;
+        payloadPart[task] = payloadPacked;
+    });
+    parallelFor(budget, G * crtModulusNumber, [&](int task) {
+        const int g = task / crtModulusNumber, q = task % crtModulusNumber;
+        T_CP keyPacked, payloadPacked;
+        for (int c = 0; c < chunkNum; c++) {
+            const T_CP &k = keyPart[task * chunkNum + c];
+            const T_CP &p = payloadPart[task * chunkNum + c];
+            if (k) {
+                keyPacked = keyPacked ? cc[q] -> EvalAdd(keyPacked, k) : k;
+                payloadPacked = payloadPacked ? cc[q] -> EvalAdd(payloadPacked, p) : p;
+            }
+        }
+        match[g][q] = cc[q] -> EvalMult(eqChain(ctKeyA[q], keyPacked, q), valid[g][q]);
+        joinedA[g][q] = cc[q] -> EvalMult(ctPayloadA[q], match[g][q]);
+        joinedB[g][q] = cc[q] -> EvalMult(payloadPacked, match[g][q]);
+    });
+    std::chrono::steady_clock::time_point t_join_after = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_join = std::chrono::duration_cast<std::chrono::duration<double>>(t_join_after - t_join_before);
+    cout << "Join time: " << time_used_for_join.count() << ", EQ chains: " << G * crtModulusNumber
+         << " (pairwise: " << (int64_t) m * n * crtModulusNumber << ")" << endl;
+
+    // Client side: a pair joins iff its slot is 1 under both moduli, payloads are recovered by CRT.
+    int joined = 0, payloadOk = 0;
+    const int64_t p0 = crtModulusVector[0], p1 = crtModulusVector[1];
+    int64_t p0InvP1 = 1;
+    for (int64_t e = p1 - 2, base = p0 % p1; e > 0; e >>= 1, base = base * base % p1) {
+        if (e & 1) {
+            p0InvP1 = p0InvP1 * base % p1;
+        }
+    }
+    auto crt = [&](int64_t r0, int64_t r1) {
+        r0 = (r0 % p0 + p0) % p0;
+        r1 = (r1 % p1 + p1) % p1;
+        return r0 + p0 * (((r1 - r0) % p1 + p1) % p1 * p0InvP1 % p1);
+    };
+    for (int g = 0; g < G; g++) {
+        Plaintext ptMatch[crtModulusNumber], ptA[crtModulusNumber], ptB[crtModulusNumber];
+        for (int q = 0; q < crtModulusNumber; q++) {
+            cc[q] -> Decrypt(keyPair[q].secretKey, match[g][q], &ptMatch[q]);
+            cc[q] -> Decrypt(keyPair[q].secretKey, joinedA[g][q], &ptA[q]);
+            cc[q] -> Decrypt(keyPair[q].secretKey, joinedB[g][q], &ptB[q]);
+        }
+        for (int s = 0; s < slots; s++) {
+            if (ptMatch[0] -> GetPackedValue()[s] != 1 || ptMatch[1] -> GetPackedValue()[s] != 1) {
+                continue;
+            }
+            const int a = s % R, b = (a + g * T + s / R) % R;
+            joined++;
+            payloadOk += crt(ptA[0] -> GetPackedValue()[s], ptA[1] -> GetPackedValue()[s]) == payloadA[a]
+                      && crt(ptB[0] -> GetPackedValue()[s], ptB[1] -> GetPackedValue()[s]) == payloadB[b];
+        }
+    }
+    int expected = 0;
+    for (int a = 0; a < m; a++) {
+        for (int b = 0; b < n; b++) {
+            expected += keyA[a] == keyB[b];
+        }
+    }
+    cout << "Joined pairs: " << joined << ", expected: " << expected << ", payloads correct: " << payloadOk << endl;
+    delete budget;
+    return 0;
+}
+
+int64_t centered(int64_t val, int64_t modulus) {
+    val %= modulus;
+    if (val < 0) {
+        val += modulus;
+    }
+    return val > modulus / 2 ? val - modulus : val;
+}
+
+// Slot s holds column[s mod R], 0 past the end of the column.
+T_CP encryptPeriodic(const vector<int64_t> &column, int q) {
+    vector<int64_t> v(slots, 0);
+    for (int s = 0; s < slots; s++) {
+        if (s % R < (int) column.size()) {
+            v[s] = centered(column[s % R], crtModulusVector[q]);
+        }
+    }
+    Plaintext pt = cc[q] -> MakePackedPlaintext(v);
+    return cc[q] -> Encrypt(keyPair[q].publicKey, pt);
+}
+
+// Rotation by any r < R from the power-of-two keys.
+T_CP rotateBy(const T_CP &ct, int r, int q) {
+    T_CP res = ct;
+    for (int k = 1; k < R; k <<= 1) {
+        if (r & k) {
+            res = cc[q] -> EvalRotate(res, k);
+        }
+    }
+    return res;
+}
+
+// 1 - (op1 - op2)^(p-1), i.e. 1 in the slots where op1 equals op2 and 0 elsewhere.
+T_CP eqChain(const T_CP &op1, const T_CP &op2, int q) {
+    auto ct = cc[q] -> EvalSub(op1, op2);
+    T_CP res;
+    for (int64_t x = crtModulusVector[q] - 1; x > 0; x >>= 1)
+    {
+        if (x & 1)
+        {
+            res = res ? cc[q]->EvalMult(ct, res) : ct;
+        }
+        if (x > 1) {
+            ct = cc[q]->EvalMult(ct, ct);
+        }
+    }
+    vector<int64_t> ones(slots, 1);
+    return cc[q] -> EvalSub(cc[q] -> MakePackedPlaintext(ones), res);
+}
@@ -0,0 +1,365 @@
+#ifndef EDB_ENGINEPLANNER_H
+#define EDB_ENGINEPLANNER_H
+
+#include "openfhe.h"
+#include "binfhecontext.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Estimated cost of one engine on one batch.
+struct EnginePlan {
+    std::string engine;    // raw, digit, rns, simd or fhew
+    int rho = 0;           // log(ρ) of the rns moduli
+    double work = 0.0;     // core-seconds for the batch
+    double latency = 0.0;  // wall seconds for the batch
+    std::string missing;   // the cost table entry the estimate lacks, empty if estimated
+
+    std::string name() const {
+        return rho ? engine + std::to_string(rho) : engine;
+    }
+};
+
+// Cost-model planner over the comparison engines.
+//
+// The per-machine cost table, enginePlanner-<hostname>.txt, holds the single-core seconds of one
+// EvalMult and one EvalRotate of a BFV context per multiplicative depth (with the ring dimension
+// OpenFHE chose for that depth) and of one FHEW gate bootstrap. `calibrate` measures every entry
+// the engines below need and writes the table, `auto` reads it. Engines in these primitives:
+//   raw    one x^(p-1) chain over the slots of 65537, up to 16 bits, EQ
+//   digit  DigitEqEngine on 65537, up to 64 bits (32 bits is the two float halves), EQ
+//   rns    one coefficient-packed chain per residue for EQ, and (P-3)/2 of them for rns_lt,
+//          P the plaintext modulus of the width, with the moduli of log(ρ) 4, 6 or 8
+//   simd   crtEQTestSIMD's packed chains under 65537 and 786433, up to 32 bits, EQ
+//   fhew   FhewEngine gates, 2w - 1 for EQ and 5w - 4 for LT, one level at a time
+// Independent chains and gates spread over the cores, so latency is the larger of the longest
+// chain and work / cores (for fhew the sum over its gate levels), and throughput is the rate at
+// which the cores sustain the batch's work.
+class EnginePlanner {
+public:
+    std::string profilePath;
+    std::map<int, std::pair<int, double>> mult;   // depth -> (ring dimension, seconds per EvalMult)
+    std::map<int, double> rotate;                 // depth -> seconds per EvalRotate
+    double gate = 0.0;                            // seconds per FHEW gate, 0 if not calibrated
+    bool calibrating;
+
+    EnginePlanner(const std::string &profilePath, bool calibrating) : profilePath(profilePath), calibrating(calibrating) {
+        std::ifstream f(profilePath);
+        std::string kind;
+        while (f >> kind) {
+            int depth, ring;
+            double seconds;
+            if (kind == "mult" && f >> depth >> ring >> seconds) {
+                mult[depth] = {ring, seconds};
+            } else if (kind == "rotate" && f >> depth >> seconds) {
+                rotate[depth] = seconds;
+            } else if (kind == "gate" && f >> seconds) {
+                gate = seconds;
+            } else {
+                break;
+            }
+        }
+    }
+
+    // Reads `auto` (the cost table of this machine) or `calibrate`, nullptr otherwise.
+    static EnginePlanner *fromInput(std::istream &in) {
+        std::string mode;
+        in >> mode;
+        if (mode != "auto" && mode != "calibrate") {
+            return nullptr;
+        }
+        char host[256] = "localhost";
+        gethostname(host, sizeof(host) - 1);
+        return new EnginePlanner(std::string("enginePlanner-") + host + ".txt", mode == "calibrate");
+    }
+
+    // The rns moduli crtEQTest uses for a message size and log(ρ), empty if there are none.
+    static std::vector<int64_t> rnsModuli(int messageSize, int rho) {
+        if (messageSize == 16) {
+            if (rho == 4) return {13, 17, 19, 23};
+            if (rho == 6) return {41, 43, 37};
+        } else if (messageSize == 32) {
+            if (rho == 4) return {7, 11, 13, 17, 19, 23, 29, 31};
+            if (rho == 6) return {73, 79, 83, 89, 97};
+        } else if (messageSize == 64) {
+            if (rho == 4) return {7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
+            if (rho == 6) return {53, 59, 61, 67, 71, 73, 79, 83, 89, 97, 101};
+            if (rho == 8) return {233, 239, 241, 251, 257, 263, 269, 271};
+        }
+        return {};
+    }
+
+    // The smallest rns message size of at least `width` bits, 0 if there is none.
+    static int rnsWidth(int width) {
+        for (int w : {16, 32, 64}) {
+            if (width <= w) {
+                return w;
+            }
+        }
+        return 0;
+    }
+
+    // EvalMults of the Fermat chain x^(p-1).
+    static int chainMults(int64_t p) {
+        int mults = 0;
+        for (int64_t x = p - 1; x > 0; x >>= 1) {
+            mults += (x & 1) ? 2 : 1;
+        }
+        return mults - 1;
+    }
+
+    // Every depth the engines use: the rns moduli, raw and digit on 65537 and simd.
+    static std::vector<int> depths() {
+        std::vector<int> d = {16, 17, 18, 19};
+        for (int w : {16, 32, 64}) {
+            for (int rho : {4, 6, 8}) {
+                for (int64_t m : rnsModuli(w, rho)) {
+                    d.push_back(floor(log2(m)));
+                }
+            }
+        }
+        std::sort(d.begin(), d.end());
+        d.erase(std::unique(d.begin(), d.end()), d.end());
+        return d;
+    }
+
+    // Times `samples` EvalMults and EvalRotates per depth and `samples` FHEW gates on one core,
+    // and writes the table. Contexts use the plaintext modulus 65537, which the packed engines
+    // need for rotations and which slightly overstates the small rns moduli.
+    void calibrate(int samples) {
+#ifdef _OPENMP
+        const int saved = omp_get_max_threads();
+        omp_set_num_threads(1);
+#endif
+        std::cout << "Cost table calibration:" << std::endl << "depth\tring\tmult\trotate" << std::endl;
+        for (int depth : depths()) {
+            lbcrypto::CCParams<lbcrypto::CryptoContextBFVRNS> parameters;
+            parameters.SetMultiplicativeDepth(depth);
+            parameters.SetPlaintextModulus(65537);
+            auto cc = lbcrypto::GenCryptoContext(parameters);
+            cc->Enable(lbcrypto::PKE);
+            cc->Enable(lbcrypto::KEYSWITCH);
+            cc->Enable(lbcrypto::LEVELEDSHE);
+            auto keyPair = cc->KeyGen();
+            cc->EvalMultKeyGen(keyPair.secretKey);
+            cc->EvalRotateKeyGen(keyPair.secretKey, {1});
+            auto ct = cc->Encrypt(keyPair.publicKey, cc->MakePackedPlaintext(std::vector<int64_t>(8, 1)));
+
+            std::chrono::steady_clock::time_point t_before_mult = std::chrono::steady_clock::now();
+            for (int s = 0; s < samples; s++) {
+                cc->EvalMult(ct, ct);
+            }
+            std::chrono::steady_clock::time_point t_before_rotate = std::chrono::steady_clock::now();
+            for (int s = 0; s < samples; s++) {
+                cc->EvalRotate(ct, 1);
+            }
+            std::chrono::steady_clock::time_point t_after_rotate = std::chrono::steady_clock::now();
+            std::chrono::duration<double> time_used_for_mult = t_before_rotate - t_before_mult;
+            std::chrono::duration<double> time_used_for_rotate = t_after_rotate - t_before_rotate;
+            mult[depth] = {(int) cc->GetRingDimension(), time_used_for_mult.count() / samples};
+            rotate[depth] = time_used_for_rotate.count() / samples;
+            std::cout << depth << "\t" << cc->GetRingDimension() << "\t" << mult[depth].second << "\t" << rotate[depth] << std::endl;
+        }
+
+        lbcrypto::BinFHEContext fhew;
+        fhew.GenerateBinFHEContext(lbcrypto::STD128);
+        auto sk = fhew.KeyGen();
+        fhew.BTKeyGen(sk);
+        auto a = fhew.Encrypt(sk, 1), b = fhew.Encrypt(sk, 0);
+        std::chrono::steady_clock::time_point t_before_gate = std::chrono::steady_clock::now();
+        for (int s = 0; s < samples; s++) {
+            fhew.EvalBinGate(lbcrypto::AND, a, b);
+        }
+        std::chrono::duration<double> time_used_for_gate = std::chrono::steady_clock::now() - t_before_gate;
+        gate = time_used_for_gate.count() / samples;
+        std::cout << "FHEW gate\t" << gate << std::endl;
+#ifdef _OPENMP
+        omp_set_num_threads(saved);
+#endif
+
+        std::ofstream f(profilePath);
+        for (const auto &entry : mult) {
+            f << "mult " << entry.first << " " << entry.second.first << " " << entry.second.second << std::endl;
+        }
+        for (const auto &entry : rotate) {
+            f << "rotate " << entry.first << " " << entry.second << std::endl;
+        }
+        f << "gate " << gate << std::endl;
+        std::cout << "Cost table written to " << profilePath << std::endl;
+    }
+
+    // Estimates of every engine that supports the predicate (`eq` or `lt`) at `width` bits.
+    std::vector<EnginePlan> estimate(int width, const std::string &predicate, int batch, int cores) const {
+        std::vector<EnginePlan> plans;
+        const bool eq = predicate == "eq";
+        cores = std::max(cores, 1);
+
+        // packed engines: the comparisons in every `stride` slots share one chain of `mults` at `depth`
+        auto packed = [&](const std::string &engine, int depth, int mults, int rotations, int stride) {
+            EnginePlan plan;
+            plan.engine = engine;
+            if (!mult.count(depth) || (rotations && !rotate.count(depth))) {
+                plan.missing = "depth " + std::to_string(depth);
+                plans.push_back(plan);
+                return;
+            }
+            const double chain = mults * mult.at(depth).second + (rotations ? rotations * rotate.at(depth) : 0.0);
+            const int perCiphertext = mult.at(depth).first / stride;
+            const int ciphertexts = (batch + perCiphertext - 1) / perCiphertext;
+            plan.work = ciphertexts * chain;
+            plan.latency = std::max(chain, plan.work / cores);
+            plans.push_back(plan);
+        };
+        const int64_t p = 65537;
+        if (eq && width <= 16) {
+            packed("raw", 17, chainMults(p), 0, 1);
+        }
+        if (eq && width <= 64) {
+            const int digitBits = std::min((int) floor(log2(p)), width);
+            const int digitNum = (width + digitBits - 1) / digitBits;
+            int stride = 1;
+            while (stride < digitNum) {
+                stride <<= 1;
+            }
+            const int levels = log2(stride);
+            const int depth = floor(log2(p)) + 1 + levels;
+            packed("digit", depth, chainMults(p) + levels, levels, stride);
+        }
+        if (eq && width <= 32) {
+            EnginePlan plan;
+            plan.engine = "simd";
+            double chain = 0.0;
+            int slots = 0;
+            for (int64_t m : {65537, 786433}) {
+                const int depth = floor(log2(m));
+                if (!mult.count(depth)) {
+                    plan.missing = "depth " + std::to_string(depth);
+                    continue;
+                }
+                chain = std::max(chain, chainMults(m) * mult.at(depth).second);
+                plan.work += chainMults(m) * mult.at(depth).second;
+                slots = slots ? std::min(slots, mult.at(depth).first) : mult.at(depth).first;
+            }
+            if (plan.missing.empty()) {
+                const int ciphertexts = (batch + slots - 1) / slots;
+                plan.work *= ciphertexts;
+                plan.latency = std::max(chain, plan.work / cores);
+            }
+            plans.push_back(plan);
+        }
+
+        const int rnsBits = rnsWidth(width);
+        for (int rho : {4, 6, 8}) {
+            const std::vector<int64_t> moduli = rnsModuli(rnsBits, rho);
+            if (moduli.empty()) {
+                continue;
+            }
+            EnginePlan plan;
+            plan.engine = "rns";
+            plan.rho = rho;
+            // rns_lt runs one EQ chain per candidate difference of the plaintext modulus
+            const double P = rnsBits == 16 ? 65537.0 : rnsBits == 32 ? 4294967311.0 : (double) INT64_MAX;
+            const double chainsPerResidue = eq ? 1.0 : (P - 3) / 2;
+            double longest = 0.0;
+            for (int64_t m : moduli) {
+                const int depth = floor(log2(m));
+                if (!mult.count(depth)) {
+                    plan.missing = "depth " + std::to_string(depth);
+                    continue;
+                }
+                const double chain = chainMults(m) * mult.at(depth).second;
+                longest = std::max(longest, chain);
+                plan.work += batch * chainsPerResidue * chain;
+            }
+            plan.latency = std::max(longest, plan.work / cores);
+            plans.push_back(plan);
+        }
+
+        if (width <= 64) {
+            EnginePlan plan;
+            plan.engine = "fhew";
+            if (gate <= 0.0) {
+                plan.missing = "gate";
+            } else {
+                // gate levels of one comparison, as FhewEngine::neq and FhewEngine::lt run them
+                std::vector<int> levels;
+                if (eq) {
+                    levels.push_back(width);
+                    for (int n = width; n > 1; n = (n + 1) / 2) {
+                        levels.push_back(n / 2);
+                    }
+                } else {
+                    levels.push_back(width);
+                    levels.push_back(width);
+                    for (int n = width; n > 1; n = (n + 1) / 2) {
+                        levels.push_back(n > 2 ? 2 * (n / 2) : n / 2);
+                        levels.push_back(n / 2);
+                    }
+                }
+                for (int level : levels) {
+                    const double gates = (double) level * batch;
+                    plan.work += gates * gate;
+                    plan.latency += ceil(gates / cores) * gate;
+                }
+            }
+            plans.push_back(plan);
+        }
+        return plans;
+    }
+
+    static double throughput(const EnginePlan &plan, int batch, int cores) {
+        return plan.work > 0.0 ? batch * std::max(cores, 1) / plan.work : 0.0;
+    }
+
+    // The estimated plan with the lowest latency (`latency`) or the highest throughput
+    // (`throughput`), nullptr if none is estimated.
+    static const EnginePlan *pick(const std::vector<EnginePlan> &plans, const std::string &goal, int batch, int cores) {
+        const EnginePlan *best = nullptr;
+        for (const auto &plan : plans) {
+            if (!plan.missing.empty()) {
+                continue;
+            }
+            if (!best || (goal == "throughput" ? throughput(plan, batch, cores) > throughput(*best, batch, cores) : plan.latency < best->latency)) {
+                best = &plan;
+            }
+        }
+        return best;
+    }
+
+    // Prints every estimate, the pick and whether it meets `target` (seconds per batch for
+    // `latency`, comparisons per second for `throughput`).
+    static void report(const std::vector<EnginePlan> &plans, const EnginePlan *best, const std::string &goal, double target, int batch, int cores) {
+        std::cout << "engine\tlatency\tcomparisons/s\twork" << std::endl;
+        for (const auto &plan : plans) {
+            std::cout << plan.name();
+            if (plan.missing.empty()) {
+                std::cout << "\t" << plan.latency << "\t" << throughput(plan, batch, cores) << "\t" << plan.work << std::endl;
+            } else {
+                std::cout << "\tnot calibrated (" << plan.missing << ")" << std::endl;
+            }
+        }
+        if (!best) {
+            std::cout << "No engine has an estimate, please calibrate the cost table." << std::endl;
+            return;
+        }
+        const bool met = goal == "throughput" ? throughput(*best, batch, cores) >= target : best->latency <= target;
+        std::cout << "Plan: " << best->name() << " on " << cores << " cores, " << (met ? "meets" : "misses") << " the " << goal
+                  << " goal of " << target << std::endl;
+    }
+};
+
+#endif
@@ -1,8 +1,28 @@
 #include "openfhe.h"
+
+// header files needed for serialization
+#include "ciphertext-ser.h"
+#include "cryptocontext-ser.h"
+#include "key/key-ser.h"
+#include "scheme/bfvrns/bfvrns-ser.h"
+#include "scheme/bgvrns/bgvrns-ser.h"
+#include "utils/prng/blake2engine.h"
+#include "checkpoint.h"
+#include "numaPlacement.h"
+#include "threadBudget.h"
+#include "taskGraph.h"
+#include "bucketIndex.h"
+#include "seededEncryption.h"
+
+#include <zlib.h>
+#include <sstream>
+#include <array>
+#include <functional>
 #include <random>
 #include <chrono>
 #include <cmath>
 #include <map>
+#include <numeric>
 #include <cstdint>
 
 using namespace lbcrypto;
@@ -20,25 +40,63 @@ const vector<int64_t> rnsModulusVector = {7, 11, 13, 17, 19, 23, 29, 31};
 CryptoContext<DCRTPoly> cc[rnsModulusNumber];
 KeyPair<DCRTPoly> keyPair[rnsModulusNumber];
 
+// Serialized bytes of every protocol message, per phase and per modulus.
+enum CommPhase { SETUP, UPLOAD, QUERY, INTERMEDIATE, RESPONSE, PHASE_NUMBER };
+const string commPhaseName[PHASE_NUMBER] = {"setup", "upload", "query", "intermediate", "response"};
+size_t commBytes[PHASE_NUMBER][rnsModulusNumber];
+
+// `BFV` or `BGV`. The protocol only uses EvalAdd, EvalSub, EvalMult and Compress, so the same
+// query plan runs on either; BGV switches the modulus down after every multiplication.
+string scheme = "BFV";
+const vector<string> schemeNames = {"BFV", "BGV"};
 
-void evalProtocol(int tau, int numEq, int numLT, string aggr);
+
+void evalProtocol(int tau, int numEq, int numLT, string aggr, string encMode, Checkpointer *ckpt, NumaPlacement *numa, ThreadBudget *budget, int graphThreads,
+                  BucketIndex *index);
+void runQueryGraph(int tau, int numEq, int numLT, const string &aggr, const vector<vector<std::array<T_CP, rnsModulusNumber>>> &ctRnsData,
+                   T_CP ctQuery[][rnsModulusNumber], vector<std::array<T_CP, rnsModulusNumber>> &X, vector<std::array<T_CP, rnsModulusNumber>> &result,
+                   int threads);
+void forEachModulus(NumaPlacement *numa, const std::function<void(int)> &fn, bool serial = false);
 T_CP rns_eq(const T_CP &op1, const T_CP &op2, int q);
 T_CP rns_lt(const T_CP &op1, const T_CP &op2, int q);
+int minResponseTowers(const T_CP &ct, int q);
+int responseTowers(const T_CP &ct, int q);
+string encodeResponse(const T_CP &ct, int towers, int q);
+T_CP decodeResponse(const string &msg);
+void encodeResponses(const vector<std::array<T_CP, rnsModulusNumber>> &result, const vector<int> &rows);
+T_CP encryptUpload(const Plaintext &pt, int q, const string &encMode, size_t &bytes);
+void countSetupBytes();
+void printCommCost(int tau);
+void reportSchemes();
+
+
+template <class Scheme>
+CryptoContext<DCRTPoly> genSchemeContext(int64_t modulus, int depth) {
+    CCParams<Scheme> parameters;
+    parameters.SetMultiplicativeDepth(depth);
+    parameters.SetPlaintextModulus(modulus);
+    return GenCryptoContext(parameters);
+}
 
 
-void initCcNoSIMD() {
-    for (int i = 0; i < rnsModulusNumber; i++) {
-        const int modulus = rnsModulusVector[i];
-        CCParams<CryptoContextBFVRNS> parameters;
-        parameters.SetMultiplicativeDepth(floor(log2(modulus)) + 4);
-        parameters.SetPlaintextModulus(modulus);
-        cc[i] = GenCryptoContext(parameters);
-        cc[i]->Enable(PKE);
-        cc[i]->Enable(KEYSWITCH);
-        cc[i]->Enable(LEVELEDSHE);
-        keyPair[i] = cc[i]->KeyGen();
-        cc[i]->EvalMultKeyGen(keyPair[i].secretKey);
+void initCcModulus(int i) {
+    const int modulus = rnsModulusVector[i];
+    const int depth = floor(log2(modulus)) + 4;
+    if (scheme == "BGV") {
+        cc[i] = genSchemeContext<CryptoContextBGVRNS>(modulus, depth);
+    } else {
+        cc[i] = genSchemeContext<CryptoContextBFVRNS>(modulus, depth);
     }
+    cc[i]->Enable(PKE);
+    cc[i]->Enable(KEYSWITCH);
+    cc[i]->Enable(LEVELEDSHE);
+    keyPair[i] = cc[i]->KeyGen();
+    cc[i]->EvalMultKeyGen(keyPair[i].secretKey);
+}
+
+// Context and key generation register in OpenFHE's global tables, hence serial.
+void initCcNoSIMD(NumaPlacement *numa) {
+    forEachModulus(numa, initCcModulus, true);
     cout << "CryptoContext and KeyPair generatation is done." << endl;
 }
 
@@ -52,114 +110,309 @@ int main() {
     int numEq, numLT;
     string aggr;
     cin >> numEq >> numLT >> aggr;
+    cout << "Please input the encryption mode for uploads and queries, `pk` for public-key encryption or `seeded` for seeded secret-key encryption." << endl;
+    string encMode;
+    cin >> encMode;
+    cout << "Please input the checkpoint directory for the Group phase (`none` to disable), the client directory for the secret keys, the checkpoint interval in seconds and in operations (0 disables either) and `new` or `resume`, e.g.: ckpt ckpt-client 600 0 new" << endl;
+    Checkpointer *ckpt = Checkpointer::fromInput(cin);
+    cout << "Please input the placement mode, `none` or `numa N` to pin the moduli to the first N NUMA nodes (0 for all), e.g.: numa 0" << endl;
+    NumaPlacement *numa = NumaPlacement::fromInput(cin, rnsModulusVector);
+    cout << "Please input the thread budget between records and OpenFHE's inner loops: `none`, `auto` (tuned profile of this machine if any) or `tune`" << endl;
+    ThreadBudget *budget = ThreadBudget::fromInput(cin);
+    cout << "Please input the execution mode, `phases` or `graph N` for the work-stealing task graph on N workers (0 for all cores), e.g.: graph 0" << endl;
+    string execMode;
+    int graphThreads = 0;
+    cin >> execMode;
+    if (execMode == "graph") {
+        cin >> graphThreads;
+        if (graphThreads <= 0) {
+            graphThreads = ThreadBudget::currentCores();
+        }
+    }
+    cout << "Please input the key index mode, `none` or `bucket B D pad|nopad` for B secret buckets on the first equality column, D decoy buckets per query and optional padding of every bucket to the largest, e.g.: bucket 16 1 pad" << endl;
+    BucketIndex *index = BucketIndex::fromInput(cin);
+    if (index && graphThreads > 0) {
+        cout << "The task graph evaluates every record and does not support the key index, please use `phases` with `bucket`." << endl;
+        delete index;
+        delete budget;
+        delete numa;
+        delete ckpt;
+        return 0;
+    }
+    if (graphThreads > 0 && (numa || budget)) {
+        cout << "Note: the task graph schedules the query on its own " << graphThreads << " workers, so the NUMA placement only applies to "
+             << "key generation and encryption, and the thread budget is not used for the query." << endl;
+    }
+    cout << "Please input the scheme, `BFV` or `BGV`, and `report` to first compare the EQ latency and ciphertext sizes of both per modulus or `none`, e.g.: BGV report" << endl;
+    string schemeReport;
+    cin >> scheme >> schemeReport;
+    if (scheme != "BGV") {
+        scheme = "BFV";
+    }
+    if (useSIMD == "none" && schemeReport == "report") {
+        reportSchemes();
+    }
     if (useSIMD == "none") {
         // double multTime = 0.0;
-        evalProtocol(tau, numEq, numLT, aggr);
+        evalProtocol(tau, numEq, numLT, aggr, encMode, ckpt, numa, budget, graphThreads, index);
     }
+    delete index;
+    delete budget;
+    delete numa;
+    delete ckpt;
     return 0;
 }
 
-void evalProtocol(int tau, int numEq, int numLT, string aggr) {
+void evalProtocol(int tau, int numEq, int numLT, string aggr, string encMode, Checkpointer *ckpt, NumaPlacement *numa, ThreadBudget *budget, int graphThreads,
+                  BucketIndex *index) {
     
     int columnNum = numEq + numLT + 1;
     if (aggr != "none") {
         columnNum++;
     }
     
-    int64_t ptRnsData[tau][columnNum][rnsModulusNumber];
-    T_CP ctRnsData[tau][columnNum][rnsModulusNumber];
+    // Vectors rather than arrays of runtime bound, so the per-modulus lambdas can capture them.
+    vector<vector<std::array<int64_t, rnsModulusNumber>>> ptRnsData(tau, vector<std::array<int64_t, rnsModulusNumber>>(columnNum));
+    vector<vector<std::array<T_CP, rnsModulusNumber>>> ctRnsData(tau, vector<std::array<T_CP, rnsModulusNumber>>(columnNum));
     
     
-    vector<int64_t> tmp(1);
     vector<int64_t> vectorOfInts1 = {1};
     vector<int64_t> vectorOfInts0 = {0};
 
-    // Generate random data and encrypt.
-    {
-        std::default_random_engine dre;
-        dre.seed(time(0));
-        std::uniform_int_distribution<int64_t> u = std::uniform_int_distribution<int64_t>(0, plaintextModulus);
-
-        initCcNoSIMD();
-        for (int i = 0; i < tau; i++) {
-            for (int j = 0; j < columnNum; j++) {
-                int64_t num = u(dre);
+    // A resumed run takes the contexts, the encrypted store and the query results from the
+    // checkpoint and continues the Group phase where it stopped.
+    vector<std::array<T_CP, rnsModulusNumber>> X(tau);
+    vector<std::array<T_CP, rnsModulusNumber>> result(tau);
+    bool graphDone = false;
+    vector<int> rows(tau);
+    std::iota(rows.begin(), rows.end(), 0);
+    vector<int64_t> position;
+    vector<vector<T_CP>> states;
+    bool resumed = false;
+    if (ckpt) {
+        ckpt->params = {tau, numEq, numLT, columnNum, rnsModulusNumber};
+    }
+    if (ckpt && ckpt->resume) {
+        vector<CryptoContext<DCRTPoly>> ccs(rnsModulusNumber);
+        vector<KeyPair<DCRTPoly>> keyPairs(rnsModulusNumber);
+        resumed = ckpt->loadContexts(ccs, keyPairs) && ckpt->load(position, states)
+                  && position.size() == 3 && !states.empty() && states[0].size() == (size_t) tau * (columnNum + 1) * rnsModulusNumber;
+        if (resumed) {
+            size_t k = 0;
+            for (int q = 0; q < rnsModulusNumber; q++) {
+                cc[q] = ccs[q];
+                keyPair[q] = keyPairs[q];
+            }
+            for (int i = 0; i < tau; i++) {
+                for (int j = 0; j < columnNum; j++) {
+                    for (int q = 0; q < rnsModulusNumber; q++) {
+                        ctRnsData[i][j][q] = states[0][k++];
+                    }
+                }
                 for (int q = 0; q < rnsModulusNumber; q++) {
-                    int64_t rns_val = (num % (rnsModulusVector[q])) - rnsModulusVector[q] / 2;
-                    ptRnsData[i][j][q] = rns_val;
-                    tmp[0] = rns_val;
-                    Plaintext ptrns_val = cc[q] -> MakeCoefPackedPlaintext(tmp);
-                    auto ct = cc[q] -> Encrypt(keyPair[q].publicKey, ptrns_val);
-                    ctRnsData[i][j][q] = ct;
+                    X[i][q] = states[0][k++];
                 }
             }
+            cout << "Resumed from checkpoint at modulus " << position[0] << ", record " << position[1] << "." << endl;
         }
-        cout << "Data generation and encryption is done." << endl;
     }
 
-    // Generate the query. Suppose the query condition is just the same as the first record.
-    T_CP ctQuery[numEq + numLT][rnsModulusNumber];
-    {
-        for (int j = 0; j < numEq + numLT; j++) {
-            for (int q = 0; q < rnsModulusNumber; q++) {
-                tmp[0] = ptRnsData[0][j][q];
-                Plaintext pt = cc[q] -> MakeCoefPackedPlaintext(tmp);
-                auto ct = cc[q] -> Encrypt(keyPair[q].publicKey, pt);
-                ctQuery[j][q] = ct;
+    if (!resumed) {
+        // Generate random data and encrypt.
+        {
+            std::default_random_engine dre;
+            dre.seed(time(0));
+            std::uniform_int_distribution<int64_t> u = std::uniform_int_distribution<int64_t>(0, plaintextModulus);
+
+            initCcNoSIMD(numa);
+            countSetupBytes();
+            if (budget && budget -> tuning) {
+                const int q = rnsModulusNumber - 1;
+                budget -> tune(cc[q], keyPair[q].publicKey, floor(log2(rnsModulusVector[q])));
+            }
+            for (int i = 0; i < tau; i++) {
+                for (int j = 0; j < columnNum; j++) {
+                    int64_t num = u(dre);
+                    for (int q = 0; q < rnsModulusNumber; q++) {
+                        ptRnsData[i][j][q] = (num % (rnsModulusVector[q])) - rnsModulusVector[q] / 2;
+                    }
+                }
+            }
+            // The data owner assigns the buckets before upload and pads them with dummy records
+            // of random values, which are encrypted and stored like real ones after row tau.
+            if (index) {
+                for (int i = 0; i < tau; i++) {
+                    index -> add(i, index -> bucketOf(ptRnsData[i][0]));
+                }
+                vector<int> need = index -> paddingNeeded();
+                for (int b = 0; b < index -> bucketNum; b++) {
+                    for (int k = 0; k < need[b]; k++) {
+                        index -> add(ptRnsData.size(), b);
+                        ptRnsData.emplace_back(columnNum);
+                        for (int j = 0; j < columnNum; j++) {
+                            int64_t num = u(dre);
+                            for (int q = 0; q < rnsModulusNumber; q++) {
+                                ptRnsData.back()[j][q] = (num % (rnsModulusVector[q])) - rnsModulusVector[q] / 2;
+                            }
+                        }
+                    }
+                }
+                index -> dummyNum = ptRnsData.size() - tau;
+                ctRnsData.resize(ptRnsData.size(), vector<std::array<T_CP, rnsModulusNumber>>(columnNum));
+                X.resize(ptRnsData.size());
+                result.resize(ptRnsData.size());
             }
+            // Encrypted on the node of each modulus, so the ciphertexts are allocated there.
+            forEachModulus(numa, [&](int q) {
+                vector<int64_t> tmp(1);
+                for (size_t i = 0; i < ptRnsData.size(); i++) {
+                    for (int j = 0; j < columnNum; j++) {
+                        tmp[0] = ptRnsData[i][j][q];
+                        Plaintext ptrns_val = cc[q] -> MakeCoefPackedPlaintext(tmp);
+                        ctRnsData[i][j][q] = encryptUpload(ptrns_val, q, encMode, commBytes[UPLOAD][q]);
+                    }
+                }
+            });
+            cout << "Data generation and encryption is done." << endl;
         }
-        cout << "Query generation and encryption is done." << endl;
-    }
-        
-    // Process the query conditions.
-    T_CP X[tau][rnsModulusNumber];
-    for (int i = 0; i < tau; i++) {
-        for (int q = 0; q < rnsModulusNumber; q++) {
-            Plaintext ptOne = cc[q] -> MakeCoefPackedPlaintext(vectorOfInts1);
-            X[i][q] = cc[q] -> Encrypt(keyPair[q].publicKey, ptOne);
+
+        // Records the server evaluates the conditions on: all of them, or the records of the
+        // query's bucket and its decoys.
+        if (index) {
+            std::default_random_engine dre;
+            dre.seed(time(0));
+            rows = index -> rowsOf(index -> queryBuckets(index -> bucketOf(ptRnsData[0][0]), dre));
+            index -> report(tau, rows.size(), numEq + numLT, rnsModulusNumber);
         }
-    }
-    std::chrono::steady_clock::time_point t_query_before = std::chrono::steady_clock::now();
-    {
-        for (int i = 0; i < tau; i++) {
-      
-            for (int j = 0; j < numEq + numLT; j++) {
+
+        // Generate the query. Suppose the query condition is just the same as the first record.
+        T_CP ctQuery[numEq + numLT][rnsModulusNumber];
+        {
+            forEachModulus(numa, [&](int q) {
+                vector<int64_t> tmp(1);
+                for (int j = 0; j < numEq + numLT; j++) {
+                    tmp[0] = ptRnsData[0][j][q];
+                    Plaintext pt = cc[q] -> MakeCoefPackedPlaintext(tmp);
+                    ctQuery[j][q] = encryptUpload(pt, q, encMode, commBytes[QUERY][q]);
+                }
+            });
+            cout << "Query generation and encryption is done." << endl;
+        }
+        
+        // The task graph runs conditions, Group, aggregation and retrieval as one DAG, without
+        // checkpoints, instead of the phases below.
+        if (graphThreads > 0) {
+            runQueryGraph(tau, numEq, numLT, aggr, ctRnsData, ctQuery, X, result, graphThreads);
+            graphDone = true;
+        } else {
+            // Process the query conditions.
+            forEachModulus(numa, [&](int q) {
+                for (int i : rows) {
+                    Plaintext ptOne = cc[q] -> MakeCoefPackedPlaintext(vectorOfInts1);
+                    X[i][q] = cc[q] -> Encrypt(keyPair[q].publicKey, ptOne);
+                }
+            });
+            std::chrono::steady_clock::time_point t_query_before = std::chrono::steady_clock::now();
+            if (budget) {
+                budget -> report(rows.size());
+            }
+            forEachModulus(numa, [&](int q) {
+                parallelFor(budget, rows.size(), [&](int k) {
+                    const int i = rows[k];
+
+                    for (int j = 0; j < numEq + numLT; j++) {
+                        T_CP cur;
+                        if ( j < numEq) {
+                            cur = rns_eq(ctRnsData[i][j][q], ctQuery[j][q], q);
+                        } else {
+                            cur = rns_eq(ctRnsData[i][j][q], ctQuery[j][q], q);
+                        }
+                        X[i][q] = cc[q] -> EvalMult(X[i][q], cur);
+                    }
+                });
+            });
+            std::chrono::steady_clock::time_point t_query_after = std::chrono::steady_clock::now();
+            cout << "Query conditions processed." << endl;
+            std::chrono::duration<double> time_used_for_query = std::chrono::duration_cast<std::chrono::duration<double>>(t_query_after - t_query_before);
+            cout << "Query processing time: " << time_used_for_query.count() << endl;
+
+            if (numa) {
                 for (int q = 0; q < rnsModulusNumber; q++) {
-                    T_CP cur;
-                    if ( j < numEq) {
-                        cur = rns_eq(ctRnsData[i][j][q], ctQuery[j][q], q);
-                    } else {
-                        cur = rns_eq(ctRnsData[i][j][q], ctQuery[j][q], q);
+                    numa -> sampleEvalKeys(q, cc[q], keyPair[q].secretKey -> GetKeyTag());
+                    for (int i : rows) {
+                        for (int j = 0; j < columnNum; j++) {
+                            numa -> sample(q, ctRnsData[i][j][q]);
+                        }
+                        numa -> sample(q, X[i][q]);
                     }
-                    X[i][q] = cc[q] -> EvalMult(X[i][q], cur);
                 }
+                numa -> report(rnsModulusVector);
+            }
+
+            // The bucket layout is not part of the checkpoint, so bucketized runs are not resumable.
+            if (ckpt && aggr != "none" && !index) {
+                vector<CryptoContext<DCRTPoly>> ccs(cc, cc + rnsModulusNumber);
+                vector<KeyPair<DCRTPoly>> keyPairs(keyPair, keyPair + rnsModulusNumber);
+                vector<T_CP> store;
+                for (int i = 0; i < tau; i++) {
+                    for (int j = 0; j < columnNum; j++) {
+                        store.insert(store.end(), ctRnsData[i][j].begin(), ctRnsData[i][j].end());
+                    }
+                    store.insert(store.end(), X[i].begin(), X[i].end());
+                }
+                ckpt->saveContexts(ccs, keyPairs);
+                ckpt->save({0, 0, 0}, store, true);
             }
         }
     }
-    std::chrono::steady_clock::time_point t_query_after = std::chrono::steady_clock::now();
-    cout << "Query conditions processed." << endl;
-    std::chrono::duration<double> time_used_for_query = std::chrono::duration_cast<std::chrono::duration<double>>(t_query_after - t_query_before);
-    cout << "Query processing time: " << time_used_for_query.count() << endl;
 
 
     // aggr
     T_CP Group[tau][tau][rnsModulusNumber];
     T_CP aggregationVaule[tau][rnsModulusNumber];
-    if (aggr != "none") 
+    if (aggr != "none" && !graphDone) 
     {
 
+        // Group entries are computed once and never updated, so each checkpoint appends only the
+        // entries computed since the previous one and a resumed run replays them in order.
+        vector<T_CP> replayed;
+        for (size_t k = 1; k < states.size(); k++) {
+            replayed.insert(replayed.end(), states[k].begin(), states[k].end());
+        }
+        size_t replay = 0;
+        vector<T_CP> pending;
+
+        std::chrono::steady_clock::time_point t_group_before = std::chrono::steady_clock::now();
         for (int q = 0; q < rnsModulusNumber; q++) {
             for (int i1 = 0; i1 < tau; i1++) {
                 Plaintext plaintextAllOne = cc[q] -> MakeCoefPackedPlaintext(vectorOfInts1);
                 auto ciphertextAllOne = cc[q] -> Encrypt(keyPair[q].publicKey, plaintextAllOne);
                 Group[i1][i1][q] = ciphertextAllOne;
                 for (int i2 = i1; i2 < tau; i2++) {
-                    auto r = rns_eq(ctRnsData[i1][0][q], ctRnsData[i2][0][q], q);
+                    T_CP r;
+                    if (replay < replayed.size()) {
+                        r = replayed[replay++];
+                    } else {
+                        r = rns_eq(ctRnsData[i1][0][q], ctRnsData[i2][0][q], q);
+                        if (ckpt) {
+                            pending.push_back(r);
+                            if (ckpt -> tick()) {
+                                ckpt -> save({q, i1, i2 + 1}, pending, true);
+                                pending.clear();
+                            }
+                        }
+                    }
                     Group[i1][i2][q] = r;
                     Group[i2][i1][q] = r;
                 }
             }
         }
+        std::chrono::steady_clock::time_point t_group_after = std::chrono::steady_clock::now();
+        std::chrono::duration<double> time_used_for_group = std::chrono::duration_cast<std::chrono::duration<double>>(t_group_after - t_group_before);
+        cout << "Group processing time: " << time_used_for_group.count() << endl;
+        if (ckpt) {
+            ckpt -> report(time_used_for_group.count());
+        }
 
         std::chrono::steady_clock::time_point t_aggr_before = std::chrono::steady_clock::now();
         if (aggr == "sum") {
@@ -175,7 +428,7 @@ void evalProtocol(int tau, int numEq, int numLT, string aggr) {
                 for (int i2 = 0; i2 < tau; i2++) {
                     for (int q = 0; q < rnsModulusNumber; q++) {
                         auto tmp = cc[q] -> EvalMult(ctRnsData[i2][numEq+numLT][q], Group[i1][i2][q]);
-                        aggregationVaule[i1][q] = cc[q] -> EvalAdd(aggregationVaule[i1][1], tmp);
+                        aggregationVaule[i1][q] = cc[q] -> EvalAdd(aggregationVaule[i1][q], tmp);
                     }
                 }
             }
@@ -191,7 +444,7 @@ void evalProtocol(int tau, int numEq, int numLT, string aggr) {
             for (int i1 = 0; i1 < tau; i1++) {
                 for (int i2 = 0; i2 < tau; i2++) {
                     for (int q = 0; q < rnsModulusNumber; q++) {
-                        aggregationVaule[i1][q] = cc[q] -> EvalAdd(aggregationVaule[i1][1], Group[i1][i2][q]);
+                        aggregationVaule[i1][q] = cc[q] -> EvalAdd(aggregationVaule[i1][q], Group[i1][i2][q]);
                     }
                 }
             }
@@ -205,27 +458,135 @@ void evalProtocol(int tau, int numEq, int numLT, string aggr) {
 
 
     // retrieval
-    T_CP result[tau][rnsModulusNumber];
-    {
-        T_CP value[tau][rnsModulusNumber];
-        if (aggr == "none") {
-            for (int i = 0; i < tau; i++) {
-                for (int q = 0; q < rnsModulusNumber; q++) {
+    if (!graphDone) {
+        // Dummy records have no aggregate and return their own value column.
+        T_CP value[result.size()][rnsModulusNumber];
+        for (int i : rows) {
+            for (int q = 0; q < rnsModulusNumber; q++) {
+                if (aggr == "none" || i >= tau) {
                     value[i][q] = ctRnsData[i][numEq+numLT][q];
+                } else {
+                    value[i][q] = aggregationVaule[i][q];
                 }
             }
         }
 
-        for (int i = 0; i < tau; i++) {
-            for (int q = 0; q < rnsModulusNumber; q++) {
+        forEachModulus(numa, [&](int q) {
+            parallelFor(budget, rows.size(), [&](int k) {
+                const int i = rows[k];
                 result[i][q] = cc[q] -> EvalMult(value[i][q], X[i][q]);
-            }
-        }
+            });
+        });
 
         cout << "Retrieval finished." << endl;
     }
+
+    encodeResponses(result, rows);
+    printCommCost(tau);
+}
+
+// Runs fn(q) for every modulus, on the cores of its NUMA node when a placement is given.
+void forEachModulus(NumaPlacement *numa, const std::function<void(int)> &fn, bool serial) {
+    if (numa) {
+        numa -> run(fn, serial);
+        return;
+    }
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        fn(q);
+    }
+}
+
+// EvalMults of rns_eq under modulus q, the cost hint of the task graph.
+double eqCost(int q) {
+    double cost = 1.0;
+    for (int64_t x = rnsModulusVector[q] - 1; x > 0; x >>= 1) {
+        cost += (x & 1) ? 2 : 1;
+    }
+    return cost;
 }
 
+// Lowers the query into tasks per record, modulus and condition (rns_eq), per record and modulus
+// (AND of the conditions, then retrieval), and for aggregation per modulus and record pair (Group)
+// and per record and modulus (sum/count), and runs them on the work-stealing pool. Retrieval waits
+// for both the AND and the aggregate of its record, so conditions and Group interleave.
+void runQueryGraph(int tau, int numEq, int numLT, const string &aggr, const vector<vector<std::array<T_CP, rnsModulusNumber>>> &ctRnsData,
+                   T_CP ctQuery[][rnsModulusNumber], vector<std::array<T_CP, rnsModulusNumber>> &X, vector<std::array<T_CP, rnsModulusNumber>> &result,
+                   int threads) {
+    const int numCond = numEq + numLT;
+    const int valueColumn = numEq + numLT;
+    vector<int64_t> vectorOfInts1 = {1};
+    vector<int64_t> vectorOfInts0 = {0};
+    vector<T_CP> cur(tau * rnsModulusNumber * numCond);
+    vector<T_CP> group(aggr != "none" ? rnsModulusNumber * tau * tau : 0);
+    vector<T_CP> aggregation(tau * rnsModulusNumber);
+
+    TaskGraph graph;
+    vector<int> andTask(tau * rnsModulusNumber), aggrTask(tau * rnsModulusNumber, -1);
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        for (int i = 0; i < tau; i++) {
+            vector<int> deps;
+            for (int j = 0; j < numCond; j++) {
+                deps.push_back(graph.addTask(eqCost(q), [&, i, j, q]() {
+                    cur[(i * rnsModulusNumber + q) * numCond + j] = rns_eq(ctRnsData[i][j][q], ctQuery[j][q], q);
+                }));
+            }
+            andTask[i * rnsModulusNumber + q] = graph.addTask(numCond, [&, i, q]() {
+                Plaintext ptOne = cc[q] -> MakeCoefPackedPlaintext(vectorOfInts1);
+                X[i][q] = cc[q] -> Encrypt(keyPair[q].publicKey, ptOne);
+                for (int j = 0; j < numCond; j++) {
+                    X[i][q] = cc[q] -> EvalMult(X[i][q], cur[(i * rnsModulusNumber + q) * numCond + j]);
+                }
+            }, deps);
+        }
+    }
+
+    if (aggr != "none") {
+        for (int q = 0; q < rnsModulusNumber; q++) {
+            vector<vector<int>> groupTask(tau, vector<int>(tau));
+            for (int i1 = 0; i1 < tau; i1++) {
+                for (int i2 = i1; i2 < tau; i2++) {
+                    groupTask[i1][i2] = groupTask[i2][i1] = graph.addTask(eqCost(q), [&, q, i1, i2]() {
+                        T_CP r = rns_eq(ctRnsData[i1][0][q], ctRnsData[i2][0][q], q);
+                        group[(q * tau + i1) * tau + i2] = r;
+                        group[(q * tau + i2) * tau + i1] = r;
+                    });
+                }
+            }
+            for (int i1 = 0; i1 < tau; i1++) {
+                aggrTask[i1 * rnsModulusNumber + q] = graph.addTask(aggr == "sum" ? tau : 1, [&, q, i1]() {
+                    Plaintext ptZero = cc[q] -> MakeCoefPackedPlaintext(vectorOfInts0);
+                    T_CP acc = cc[q] -> Encrypt(keyPair[q].publicKey, ptZero);
+                    for (int i2 = 0; i2 < tau; i2++) {
+                        const T_CP &g = group[(q * tau + i1) * tau + i2];
+                        acc = cc[q] -> EvalAdd(acc, aggr == "sum" ? cc[q] -> EvalMult(ctRnsData[i2][valueColumn][q], g) : g);
+                    }
+                    aggregation[i1 * rnsModulusNumber + q] = acc;
+                }, groupTask[i1]);
+            }
+        }
+    }
+
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        for (int i = 0; i < tau; i++) {
+            vector<int> deps = {andTask[i * rnsModulusNumber + q]};
+            if (aggrTask[i * rnsModulusNumber + q] >= 0) {
+                deps.push_back(aggrTask[i * rnsModulusNumber + q]);
+            }
+            graph.addTask(1, [&, i, q]() {
+                const T_CP &value = aggr == "none" ? ctRnsData[i][valueColumn][q] : aggregation[i * rnsModulusNumber + q];
+                result[i][q] = cc[q] -> EvalMult(value, X[i][q]);
+            }, deps);
+        }
+    }
+
+    const int cores = ThreadBudget::currentCores();
+    std::chrono::steady_clock::time_point t_graph_before = std::chrono::steady_clock::now();
+    graph.run(threads, std::max(1, cores / threads));
+    std::chrono::steady_clock::time_point t_graph_after = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_graph = std::chrono::duration_cast<std::chrono::duration<double>>(t_graph_after - t_graph_before);
+    cout << "Query graph processing time: " << time_used_for_graph.count() << endl;
+    graph.report(time_used_for_graph.count());
+}
 
 T_CP rns_eq(const T_CP &op1, const T_CP &op2, int q) {
 
@@ -259,4 +620,191 @@ T_CP rns_lt(const T_CP &op1, const T_CP &op2, int q) {
         res = cc[q] -> EvalAdd(cur, res);
     }
     return res;
-}
\ No newline at end of file
+}
+
+// Smallest number of RNS towers `ct` can be compressed to and still decrypt to the same plaintext.
+int minResponseTowers(const T_CP &ct, int q) {
+    Plaintext expected;
+    cc[q] -> Decrypt(keyPair[q].secretKey, ct, &expected);
+    const int towers = ct -> GetElements()[0].GetNumOfElements();
+    for (int t = 1; t < towers; t++) {
+        Plaintext pt;
+        auto reduced = cc[q] -> Compress(ct, t);
+        cc[q] -> Decrypt(keyPair[q].secretKey, reduced, &pt);
+        if (pt -> GetCoefPackedValue() == expected -> GetCoefPackedValue()) {
+            return t;
+        }
+    }
+    return towers;
+}
+
+// The data owner calibrates the towers once per modulus on one response and the server reuses
+// them for every response, whose noise differs, so one tower is kept above the minimum.
+int responseTowers(const T_CP &ct, int q) {
+    return std::min(minResponseTowers(ct, q) + 1, (int) ct -> GetElements()[0].GetNumOfElements());
+}
+
+// Wire format of a response: 8 bytes of serialized length followed by the zlib stream of the
+// serialized ciphertext after modulus reduction.
+string encodeResponse(const T_CP &ct, int towers, int q) {
+    std::stringstream s;
+    Serial::Serialize(cc[q] -> Compress(ct, towers), s, SerType::BINARY);
+    const string raw = s.str();
+
+    uLongf len = compressBound(raw.size());
+    string msg(sizeof(uint64_t) + len, '\0');
+    uint64_t rawLen = raw.size();
+    memcpy(&msg[0], &rawLen, sizeof(uint64_t));
+    if (compress2((Bytef *) &msg[sizeof(uint64_t)], &len, (const Bytef *) raw.data(), raw.size(), Z_BEST_COMPRESSION) != Z_OK) {
+        cout << "zlib compression failed." << endl;
+        return string();
+    }
+    msg.resize(sizeof(uint64_t) + len);
+    return msg;
+}
+
+T_CP decodeResponse(const string &msg) {
+    uint64_t rawLen;
+    memcpy(&rawLen, msg.data(), sizeof(uint64_t));
+    string raw(rawLen, '\0');
+    uLongf len = rawLen;
+    T_CP ct;
+    if (uncompress((Bytef *) &raw[0], &len, (const Bytef *) msg.data() + sizeof(uint64_t), msg.size() - sizeof(uint64_t)) != Z_OK) {
+        cout << "zlib decompression failed." << endl;
+        return ct;
+    }
+    std::stringstream s(raw);
+    Serial::Deserialize(ct, s, SerType::BINARY);
+    return ct;
+}
+
+void encodeResponses(const vector<std::array<T_CP, rnsModulusNumber>> &result, const vector<int> &rows) {
+    int64_t totalRaw = 0, totalEncoded = 0;
+    vector<vector<string>> encoded(rnsModulusNumber);
+    std::chrono::steady_clock::time_point t_encode_before = std::chrono::steady_clock::now();
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        const int towers = responseTowers(result[rows[0]][q], q);
+        int64_t rawBytes = 0, encodedBytes = 0;
+        for (int i : rows) {
+            std::stringstream s;
+            Serial::Serialize(result[i][q], s, SerType::BINARY);
+            rawBytes += s.str().size();
+            encoded[q].push_back(encodeResponse(result[i][q], towers, q));
+            encodedBytes += encoded[q].back().size();
+        }
+        cout << "modulus " << rnsModulusVector[q] << ": " << towers << " of "
+             << result[rows[0]][q] -> GetElements()[0].GetNumOfElements() << " towers, "
+             << rawBytes << " -> " << encodedBytes << " bytes, saved " << rawBytes - encodedBytes << " bytes" << endl;
+        totalRaw += rawBytes;
+        totalEncoded += encodedBytes;
+        commBytes[RESPONSE][q] += encodedBytes;
+    }
+    std::chrono::steady_clock::time_point t_encode_after = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_encode = std::chrono::duration_cast<std::chrono::duration<double>>(t_encode_after - t_encode_before);
+    cout << "Response encoding time: " << time_used_for_encode.count() << endl;
+    cout << "Response size: " << totalRaw << " -> " << totalEncoded << " bytes, saved " << totalRaw - totalEncoded << " bytes" << endl;
+
+    // the client side of the wire format, on every response since the towers were calibrated on one
+    int failed = 0;
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        for (size_t k = 0; k < rows.size(); k++) {
+            Plaintext expected, pt;
+            cc[q] -> Decrypt(keyPair[q].secretKey, result[rows[k]][q], &expected);
+            cc[q] -> Decrypt(keyPair[q].secretKey, decodeResponse(encoded[q][k]), &pt);
+            failed += pt -> GetCoefPackedValue() != expected -> GetCoefPackedValue();
+        }
+    }
+    cout << "Encoded responses decrypting correctly: " << rows.size() * rnsModulusNumber - failed << "/" << rows.size() * rnsModulusNumber << endl;
+}
+
+
+// Encrypts an upload or a query in the chosen mode and adds its wire size to `bytes`.
+T_CP encryptUpload(const Plaintext &pt, int q, const string &encMode, size_t &bytes) {
+    if (encMode == "seeded") {
+        string msg = seededEncrypt(cc[q], keyPair[q].secretKey, pt);
+        bytes += msg.size();
+        return seededExpand(msg);
+    }
+    auto ct = cc[q] -> Encrypt(keyPair[q].publicKey, pt);
+    std::stringstream str;
+    Serial::Serialize(ct, str, SerType::BINARY);
+    bytes += str.str().size();
+    return ct;
+}
+
+// The data owner ships the context, the public key and the relinearization key of every modulus
+// to the server once.
+void countSetupBytes() {
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        std::stringstream s;
+        Serial::Serialize(cc[q], s, SerType::BINARY);
+        Serial::Serialize(keyPair[q].publicKey, s, SerType::BINARY);
+        cc[q] -> SerializeEvalMultKey(s, SerType::BINARY, keyPair[q].secretKey -> GetKeyTag());
+        commBytes[SETUP][q] += s.str().size();
+    }
+}
+
+// The protocol is single round: the server evaluates every condition locally, so nothing is
+// counted as intermediate unless a variant sends per-condition results back and forth.
+void printCommCost(int tau) {
+    cout << "Communication cost in bytes:" << endl << "phase\ttotal\tper record";
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        cout << "\tmod " << rnsModulusVector[q];
+    }
+    cout << endl;
+
+    size_t total[rnsModulusNumber] = {0};
+    size_t totalAll = 0;
+    for (int ph = 0; ph < PHASE_NUMBER; ph++) {
+        size_t phaseTotal = 0;
+        for (int q = 0; q < rnsModulusNumber; q++) {
+            phaseTotal += commBytes[ph][q];
+            total[q] += commBytes[ph][q];
+        }
+        totalAll += phaseTotal;
+        cout << commPhaseName[ph] << "\t" << phaseTotal << "\t" << (double) phaseTotal / tau;
+        for (int q = 0; q < rnsModulusNumber; q++) {
+            cout << "\t" << commBytes[ph][q];
+        }
+        cout << endl;
+    }
+    cout << "total\t" << totalAll << "\t" << (double) totalAll / tau;
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        cout << "\t" << total[q];
+    }
+    cout << endl;
+}
+
+// Per modulus and scheme: one rns_eq on equal inputs, which must decrypt to 0, the size of a
+// fresh ciphertext, of the EQ result and of its encoded response. The contexts are regenerated for the protocol afterwards.
+void reportSchemes() {
+    const string chosen = scheme;
+    cout << "modulus\tscheme\tring\ttowers\tEQ time\tfresh bytes\tEQ bytes\tresponse bytes\tcorrect" << endl;
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        for (const string &name : schemeNames) {
+            scheme = name;
+            initCcModulus(q);
+            vector<int64_t> tmp = {rnsModulusVector[q] / 3};
+            Plaintext pt = cc[q] -> MakeCoefPackedPlaintext(tmp);
+            auto ct1 = cc[q] -> Encrypt(keyPair[q].publicKey, pt);
+            auto ct2 = cc[q] -> Encrypt(keyPair[q].publicKey, pt);
+
+            std::chrono::steady_clock::time_point t_eq_before = std::chrono::steady_clock::now();
+            auto res = rns_eq(ct1, ct2, q);
+            std::chrono::steady_clock::time_point t_eq_after = std::chrono::steady_clock::now();
+            std::chrono::duration<double> time_used_for_eq = std::chrono::duration_cast<std::chrono::duration<double>>(t_eq_after - t_eq_before);
+
+            std::stringstream fresh, eq;
+            Serial::Serialize(ct1, fresh, SerType::BINARY);
+            Serial::Serialize(res, eq, SerType::BINARY);
+            const size_t responseBytes = encodeResponse(res, responseTowers(res, q), q).size();
+            Plaintext ptRes;
+            cc[q] -> Decrypt(keyPair[q].secretKey, res, &ptRes);
+            cout << rnsModulusVector[q] << "\t" << name << "\t" << cc[q] -> GetRingDimension() << "\t"
+                 << ct1 -> GetElements()[0].GetNumOfElements() << " -> " << res -> GetElements()[0].GetNumOfElements() << "\t"
+                 << time_used_for_eq.count() << "\t" << fresh.str().size() << "\t" << eq.str().size() << "\t" << responseBytes << "\t"
+                 << (ptRes -> GetCoefPackedValue()[0] == 0) << endl;
+        }
+    }
+    scheme = chosen;
+}
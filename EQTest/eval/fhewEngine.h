@@ -0,0 +1,483 @@
+#ifndef EDB_FHEWENGINE_H
+#define EDB_FHEWENGINE_H
+
+#include "binfhecontext.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Worker threads for FHEW gate work, started once so that gate timings do not pay for thread
+// creation. `run` hands out the tasks of one call through a shared counter, and the calling
+// thread works as worker 0.
+class GatePool {
+public:
+    explicit GatePool(int threads) : threads(std::max(threads, 1)) {
+        for (int w = 1; w < this->threads; w++) {
+            workers.emplace_back([this, w]() { loop(w); });
+        }
+    }
+
+    ~GatePool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+            generation++;
+        }
+        wake.notify_all();
+        for (auto &t : workers) {
+            t.join();
+        }
+    }
+
+    int size() const {
+        return threads;
+    }
+
+    // Runs fn(task, worker) for every task in [0, tasks) and returns once all of them are done.
+    void run(int tasks, const std::function<void(int, int)> &fn) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            job = &fn;
+            taskNum = tasks;
+            next = 0;
+            busy = threads - 1;
+            generation++;
+        }
+        wake.notify_all();
+        work(0);
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [this]() { return busy == 0; });
+        job = nullptr;
+    }
+
+private:
+    int threads;
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake, done;
+    const std::function<void(int, int)> *job = nullptr;
+    int taskNum = 0;
+    std::atomic<int> next{0};
+    int busy = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    void work(int w) {
+        for (int t = next++; t < taskNum; t = next++) {
+            (*job)(t, w);
+        }
+    }
+
+    void loop(int w) {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&]() { return generation != seen; });
+                seen = generation;
+                if (stopping) {
+                    return;
+                }
+            }
+            work(w);
+            std::lock_guard<std::mutex> guard(lock);
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        }
+    }
+};
+
+// Bitwise FHEW gate engine: bit encryption under one key and batched gate levels on a GatePool.
+//
+// Every call evaluates one level of independent gates for a whole batch of comparisons at once,
+// so the pool always has batch * width bootstraps to spread over its threads. Each gate writes
+// its own output node and no accumulator is shared between threads. `gateTime` and `gates` count
+// only the gate levels.
+class FhewEngine {
+public:
+    using LWE = lbcrypto::LWECiphertext;
+
+    lbcrypto::BinFHEContext &cc;
+    lbcrypto::LWEPrivateKey sk;
+    GatePool pool;
+    double gateTime = 0.0;
+    size_t gates = 0;
+
+    FhewEngine(lbcrypto::BinFHEContext &cc, const lbcrypto::LWEPrivateKey &sk, int threads) : cc(cc), sk(sk), pool(threads) {}
+
+    // The low `bits` bits of `value`, least significant first.
+    std::vector<LWE> encryptBits(uint64_t value, int bits) const {
+        std::vector<LWE> ct(bits);
+        for (int i = 0; i < bits; i++) {
+            ct[i] = cc.Encrypt(sk, (value >> i) & 1);
+        }
+        return ct;
+    }
+
+    int decryptBit(const LWE &ct) const {
+        lbcrypto::LWEPlaintext bit;
+        cc.Decrypt(sk, ct, &bit);
+        return bit & 1;
+    }
+
+    // out[k][i] = gate(a[k][i], b[k][i]) for every comparison k and bit i.
+    std::vector<std::vector<LWE>> bitwise(lbcrypto::BINGATE gate, const std::vector<std::vector<LWE>> &a, const std::vector<std::vector<LWE>> &b) {
+        std::vector<std::vector<LWE>> out(a.size());
+        std::vector<std::pair<int, int>> slots;
+        for (size_t k = 0; k < a.size(); k++) {
+            out[k].resize(a[k].size());
+            for (size_t i = 0; i < a[k].size(); i++) {
+                slots.push_back({(int) k, (int) i});
+            }
+        }
+        level(slots.size(), [&](int t) {
+            const int k = slots[t].first, i = slots[t].second;
+            out[k][i] = cc.EvalBinGate(gate, a[k][i], b[k][i]);
+        });
+        return out;
+    }
+
+    // Reduces every row with `gate` in a balanced tree of depth log2(width); all rows of the
+    // batch share each level.
+    std::vector<LWE> reduce(lbcrypto::BINGATE gate, std::vector<std::vector<LWE>> rows) {
+        while (true) {
+            std::vector<std::pair<int, int>> pairs;
+            for (size_t k = 0; k < rows.size(); k++) {
+                for (size_t i = 0; i + 1 < rows[k].size(); i += 2) {
+                    pairs.push_back({(int) k, (int) i});
+                }
+            }
+            if (pairs.empty()) {
+                break;
+            }
+            level(pairs.size(), [&](int t) {
+                const int k = pairs[t].first, i = pairs[t].second;
+                rows[k][i] = cc.EvalBinGate(gate, rows[k][i], rows[k][i + 1]);
+            });
+            for (auto &row : rows) {
+                size_t kept = 0;
+                for (size_t i = 0; i < row.size(); i += 2) {
+                    row[kept++] = row[i];
+                }
+                row.resize(kept);
+            }
+        }
+        std::vector<LWE> roots;
+        for (const auto &row : rows) {
+            roots.push_back(row[0]);
+        }
+        return roots;
+    }
+
+    // Encryptions of 0 where a[k] equals b[k] and 1 otherwise: XOR per bit, then an OR tree.
+    std::vector<LWE> neq(const std::vector<std::vector<LWE>> &a, const std::vector<std::vector<LWE>> &b) {
+        return reduce(lbcrypto::OR, bitwise(lbcrypto::XOR, a, b));
+    }
+
+    // Encryptions of 1 where a[k] < b[k] as unsigned numbers, by a parallel prefix comparator.
+    //
+    // Every bit starts as a node (L, E) = (!a_i & b_i, a_i XNOR b_i), less-than and equal on that
+    // bit. Adjacent nodes combine as L = L_hi | (E_hi & L_lo), E = E_hi & E_lo, so log2(bits)
+    // rounds of two gate levels each reach the root; the root's E is never needed and skipped.
+    std::vector<LWE> lt(const std::vector<std::vector<LWE>> &a, const std::vector<std::vector<LWE>> &b) {
+        std::vector<std::vector<LWE>> notA(a.size());
+        for (size_t k = 0; k < a.size(); k++) {
+            for (const auto &bit : a[k]) {
+                notA[k].push_back(cc.EvalNOT(bit));
+            }
+        }
+        auto less = bitwise(lbcrypto::AND, notA, b);
+        auto equal = bitwise(lbcrypto::XNOR, a, b);
+
+        while (true) {
+            // (row, low node, whether E is still needed)
+            std::vector<std::tuple<int, int, bool>> pairs;
+            for (size_t k = 0; k < less.size(); k++) {
+                for (size_t i = 0; i + 1 < less[k].size(); i += 2) {
+                    pairs.push_back(std::make_tuple((int) k, (int) i, less[k].size() > 2));
+                }
+            }
+            if (pairs.empty()) {
+                break;
+            }
+            // Even tasks compute E_hi & L_lo, odd ones E_hi & E_lo.
+            std::vector<int> ands;
+            for (size_t t = 0; t < pairs.size(); t++) {
+                ands.push_back(2 * t);
+                if (std::get<2>(pairs[t])) {
+                    ands.push_back(2 * t + 1);
+                }
+            }
+            std::vector<LWE> carry(pairs.size()), joint(pairs.size());
+            level(ands.size(), [&](int t) {
+                const int pair = ands[t] / 2;
+                const int k = std::get<0>(pairs[pair]), i = std::get<1>(pairs[pair]);
+                if (ands[t] % 2 == 0) {
+                    carry[pair] = cc.EvalBinGate(lbcrypto::AND, equal[k][i + 1], less[k][i]);
+                } else {
+                    joint[pair] = cc.EvalBinGate(lbcrypto::AND, equal[k][i + 1], equal[k][i]);
+                }
+            });
+            level(pairs.size(), [&](int t) {
+                const int k = std::get<0>(pairs[t]), i = std::get<1>(pairs[t]);
+                less[k][i] = cc.EvalBinGate(lbcrypto::OR, less[k][i + 1], carry[t]);
+                equal[k][i] = joint[t];
+            });
+            for (size_t k = 0; k < less.size(); k++) {
+                size_t kept = 0;
+                for (size_t i = 0; i < less[k].size(); i += 2) {
+                    less[k][kept] = less[k][i];
+                    equal[k][kept++] = equal[k][i];
+                }
+                less[k].resize(kept);
+                equal[k].resize(kept);
+            }
+        }
+        std::vector<LWE> roots;
+        for (const auto &row : less) {
+            roots.push_back(row[0]);
+        }
+        return roots;
+    }
+
+    // Sum-then-threshold equality, for contexts generated with arbitrary function support.
+    //
+    // Bits are encrypted with the context's largest plaintext modulus p. `digitFanIn` bits are
+    // folded without bootstrapping into center + sum 3^i (a_i - b_i), a balanced ternary number
+    // that equals center only if all of them agree, and one functional bootstrap maps it to 0/1.
+    // Those flags are then summed `orFanIn` at a time and thresholded the same way. Both sums stay
+    // in [0, p/2), where EvalFunc accepts arbitrary tables.
+    int plaintextSpace() const {
+        return cc.GetMaxPlaintextSpace().ConvertToInt();
+    }
+
+    int digitFanIn() const {
+        int k = 0;
+        for (int range = 3; range <= plaintextSpace() / 2; range *= 3) {
+            k++;
+        }
+        return std::max(k, 1);
+    }
+
+    int orFanIn() const {
+        return std::max(plaintextSpace() / 2 - 1, 2);
+    }
+
+    // Functional bootstraps per comparison of `bits` bits.
+    int thresholdGates(int bits) const {
+        int gates = 0;
+        for (int width = (bits + digitFanIn() - 1) / digitFanIn(); ; width = (width + orFanIn() - 1) / orFanIn()) {
+            gates += width;
+            if (width == 1) {
+                return gates;
+            }
+        }
+    }
+
+    // The low `bits` bits of `value` as digits of `digitBits` bits, least significant first.
+    std::vector<LWE> encryptDigits(uint64_t value, int bits, int digitBits = 1) const {
+        std::vector<LWE> ct((bits + digitBits - 1) / digitBits);
+        for (size_t i = 0; i < ct.size(); i++) {
+            ct[i] = cc.Encrypt(sk, (value >> (i * digitBits)) & ((1ULL << digitBits) - 1), lbcrypto::FRESH, plaintextSpace());
+        }
+        return ct;
+    }
+
+    int decryptDigit(const LWE &ct) const {
+        lbcrypto::LWEPlaintext m;
+        cc.Decrypt(sk, ct, &m, plaintextSpace());
+        return m;
+    }
+
+    // Same output as neq, from encryptDigits inputs.
+    std::vector<LWE> neqThreshold(const std::vector<std::vector<LWE>> &a, const std::vector<std::vector<LWE>> &b) {
+        const int p = plaintextSpace();
+        const auto &lwe = cc.GetLWEScheme();
+        const int k = digitFanIn();
+        int center = 1;
+        for (int i = 0; i < k; i++) {
+            center *= 3;
+        }
+        center /= 2;
+
+        std::vector<std::vector<LWE>> sums(a.size());
+        for (size_t r = 0; r < a.size(); r++) {
+            for (size_t i = 0; i < a[r].size(); i += k) {
+                LWE sum = std::make_shared<lbcrypto::LWECiphertextImpl>(*a[r][i]);
+                lwe -> EvalSubEq(sum, b[r][i]);
+                for (int d = 1, weight = 3; d < k && i + d < a[r].size(); d++, weight *= 3) {
+                    LWE diff = std::make_shared<lbcrypto::LWECiphertextImpl>(*a[r][i + d]);
+                    lwe -> EvalSubEq(diff, b[r][i + d]);
+                    lwe -> EvalMultConstEq(diff, weight);
+                    lwe -> EvalAddEq(sum, diff);
+                }
+                // q and p are powers of two, so the scaled center is exact.
+                lwe -> EvalAddConstEq(sum, sum -> GetModulus().ConvertToInt() / p * center);
+                sums[r].push_back(sum);
+            }
+        }
+        auto rows = lut(sums, [center](int m) { return m != center; });
+
+        const int f = orFanIn();
+        while (true) {
+            bool reduced = true;
+            for (size_t r = 0; r < rows.size(); r++) {
+                reduced = reduced && rows[r].size() == 1;
+                sums[r].clear();
+                for (size_t i = 0; i < rows[r].size(); i += f) {
+                    LWE sum = std::make_shared<lbcrypto::LWECiphertextImpl>(*rows[r][i]);
+                    for (size_t d = 1; d < (size_t) f && i + d < rows[r].size(); d++) {
+                        lwe -> EvalAddEq(sum, rows[r][i + d]);
+                    }
+                    sums[r].push_back(sum);
+                }
+            }
+            if (reduced) {
+                break;
+            }
+            rows = lut(sums, [](int m) { return m != 0; });
+        }
+        std::vector<LWE> roots;
+        for (const auto &row : rows) {
+            roots.push_back(row[0]);
+        }
+        return roots;
+    }
+
+    // Digit-level equality and order by lookup tables.
+    //
+    // Values are encrypted as digits of `digitBits` bits. Per digit, a_i - b_i is shifted into
+    // [0, 2^(digitBits+1) - 2] and one EvalFunc turns it into the trit sign(b_i - a_i) + 1.
+    // Trits then fold `digitFanIn` at a time: sum 3^j t_j has the sign of the most significant
+    // nonzero trit, so one more EvalFunc yields the trit of the whole group. The last group's
+    // table evaluates the predicate itself.
+    bool digitsFit(int digitBits) const {
+        return (2 << digitBits) - 1 <= plaintextSpace() / 2;
+    }
+
+    // Functional bootstraps per comparison of `bits` bits.
+    int digitGates(int bits, int digitBits) const {
+        const int k = digitFanIn();
+        int width = (bits + digitBits - 1) / digitBits;
+        int gates = width;
+        while (width > k) {
+            width = (width + k - 1) / k;
+            gates += width;
+        }
+        return gates + 1;
+    }
+
+    std::vector<LWE> digitEq(const std::vector<std::vector<LWE>> &a, const std::vector<std::vector<LWE>> &b, int digitBits) {
+        return digitCompare(a, b, digitBits, [](int sign) { return sign == 0; });
+    }
+
+    // Encryptions of 1 where a[k] < b[k].
+    std::vector<LWE> digitLt(const std::vector<std::vector<LWE>> &a, const std::vector<std::vector<LWE>> &b, int digitBits) {
+        return digitCompare(a, b, digitBits, [](int sign) { return sign > 0; });
+    }
+
+    // `predicate` gets the signed group sum, whose sign is that of b - a.
+    std::vector<LWE> digitCompare(const std::vector<std::vector<LWE>> &a, const std::vector<std::vector<LWE>> &b, int digitBits,
+                                  const std::function<int(int)> &predicate) {
+        const int p = plaintextSpace();
+        const auto &lwe = cc.GetLWEScheme();
+        const int offset = (1 << digitBits) - 1;
+        std::vector<std::vector<LWE>> sums(a.size());
+        for (size_t r = 0; r < a.size(); r++) {
+            for (size_t i = 0; i < a[r].size(); i++) {
+                LWE diff = std::make_shared<lbcrypto::LWECiphertextImpl>(*a[r][i]);
+                lwe -> EvalSubEq(diff, b[r][i]);
+                lwe -> EvalAddConstEq(diff, diff -> GetModulus().ConvertToInt() / p * offset);
+                sums[r].push_back(diff);
+            }
+        }
+        auto trits = lut(sums, [offset](int m) { return m < offset ? 2 : m == offset ? 1 : 0; });
+
+        const int k = digitFanIn();
+        int full = 1;
+        for (int i = 0; i < k; i++) {
+            full *= 3;
+        }
+        const int center = full / 2;
+        while (trits[0].size() > (size_t) k) {
+            trits = lut(tritSums(trits, k), [center](int m) { return m > center ? 2 : m == center ? 1 : 0; });
+        }
+        auto roots = lut(tritSums(trits, k), [center, &predicate](int m) { return predicate(m - center); });
+        std::vector<LWE> out;
+        for (const auto &row : roots) {
+            out.push_back(row[0]);
+        }
+        return out;
+    }
+
+    // sum 3^j t_j over groups of k trits, shorter groups shifted to the same center (3^k - 1) / 2.
+    std::vector<std::vector<LWE>> tritSums(const std::vector<std::vector<LWE>> &trits, int k) {
+        const int p = plaintextSpace();
+        const auto &lwe = cc.GetLWEScheme();
+        int full = 1;
+        for (int i = 0; i < k; i++) {
+            full *= 3;
+        }
+        std::vector<std::vector<LWE>> sums(trits.size());
+        for (size_t r = 0; r < trits.size(); r++) {
+            for (size_t i = 0; i < trits[r].size(); i += k) {
+                LWE sum = std::make_shared<lbcrypto::LWECiphertextImpl>(*trits[r][i]);
+                int group = 3;
+                for (int d = 1; d < k && i + d < trits[r].size(); d++, group *= 3) {
+                    LWE t = std::make_shared<lbcrypto::LWECiphertextImpl>(*trits[r][i + d]);
+                    lwe -> EvalMultConstEq(t, group);
+                    lwe -> EvalAddEq(sum, t);
+                }
+                if (group < full) {
+                    lwe -> EvalAddConstEq(sum, sum -> GetModulus().ConvertToInt() / p * ((full - group) / 2));
+                }
+                sums[r].push_back(sum);
+            }
+        }
+        return sums;
+    }
+
+    // out[r][i] = fn(m) for every sums[r][i] encrypting m in [0, p/2), one EvalFunc each.
+    std::vector<std::vector<LWE>> lut(const std::vector<std::vector<LWE>> &sums, const std::function<int(int)> &fn) {
+        // GenerateLUTviaFunction takes a plain function pointer, so `fn` is passed through a static.
+        static const std::function<int(int)> *current;
+        current = &fn;
+        auto table = cc.GenerateLUTviaFunction([](lbcrypto::NativeInteger m, lbcrypto::NativeInteger p) -> lbcrypto::NativeInteger {
+            const int64_t modulus = p.ConvertToInt();
+            return lbcrypto::NativeInteger(((*current)(m.ConvertToInt()) % modulus + modulus) % modulus);
+        }, plaintextSpace());
+        std::vector<std::vector<LWE>> out(sums.size());
+        std::vector<std::pair<int, int>> slots;
+        for (size_t r = 0; r < sums.size(); r++) {
+            out[r].resize(sums[r].size());
+            for (size_t i = 0; i < sums[r].size(); i++) {
+                slots.push_back({(int) r, (int) i});
+            }
+        }
+        level(slots.size(), [&](int t) {
+            const int r = slots[t].first, i = slots[t].second;
+            out[r][i] = cc.EvalFunc(sums[r][i], table);
+        });
+        return out;
+    }
+
+    // Runs n independent gates on the pool.
+    void level(int n, const std::function<void(int)> &gate) {
+        std::chrono::steady_clock::time_point t_before = std::chrono::steady_clock::now();
+        pool.run(n, [&](int t, int) { gate(t); });
+        std::chrono::duration<double> time_used = std::chrono::steady_clock::now() - t_before;
+        gateTime += time_used.count();
+        gates += n;
+    }
+};
+
+#endif
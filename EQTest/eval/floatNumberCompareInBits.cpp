@@ -1,9 +1,20 @@
 #include "binfhecontext.h"
+#include "fhewEngine.h"
 #include <string.h>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 using namespace lbcrypto;
 using std::cout;
 using std::endl;
 using std::memcpy;
+using std::vector;
+
+void compare32ByBits(float num1, float num2, FhewEngine& engine, LWECiphertext& res);
+void compare32ByBitsBatch(const float* nums1, const float* nums2, int batchSize, FhewEngine& engine, vector<LWECiphertext>& res, bool threshold = false);
+void compare32ByDigitsBatch(const float* nums1, const float* nums2, int batchSize, FhewEngine& engine, int digitBits,
+                            vector<LWECiphertext>& eq, vector<LWECiphertext>& lt);
 
 inline void printBits16(int32_t t) {
     for (int i = 16 - 1; i >= 0; i--) {
@@ -26,112 +37,72 @@ inline void printBits64(int64_t t) {
     cout << endl;
 }
 
-void comparePart(BinFHEContext& cc, int idxStart, int idxEnd, LWECiphertext ctNum1[32], LWECiphertext ctNum2[32], LWECiphertext& res) {
-    LWECiphertext tmp;
-    for (int i = idxStart; i < idxEnd; i++) {
-        tmp = cc.EvalBinGate(XOR, ctNum1[i], ctNum2[i]);
-        res = cc.EvalBinGate(OR, tmp, res);
-    }
-}
-
 // num1, num2 to compare
 // res is an encryption of 0
-// return encryption of 0 if num1 equals num2, 1 otherwise
-void compare32ByBits(float num1, float num2, BinFHEContext& cc, ConstLWEPrivateKey sk, LWECiphertext& res) {
-
-    int32_t byte1;
-    int32_t byte2;
-    memcpy(&byte1, &num1, sizeof(float));
-    memcpy(&byte2, &num2, sizeof(float));
-        
-    cout << "phase 0..." << endl;
-
-    LWECiphertext ctNum1[32];
-    LWECiphertext ctNum2[32];
-
-    for (int i = 0; i < 32; i++) {
-        ctNum1[i] = cc.Encrypt(sk, ((byte1 & (1 << i)) >> i));
-        ctNum2[i] = cc.Encrypt(sk, ((byte2 & (1 << i)) >> i));
-    }
-
-
-    // LWECiphertext tmp;
-    // cout << "starting compare one thread..." << endl;
-    // std::chrono::steady_clock::time_point t_before_cmp1 = std::chrono::steady_clock::now();
-
-    // for (int i = 0; i < 32; i++) {
-    //     LWECiphertext tmp = cc.EvalBinGate(XOR, ctNum1[i], ctNum2[i]);
-    //     res = cc.EvalBinGate(OR, tmp, res);
-    // }
-
-
-    // std::chrono::steady_clock::time_point t_after_cmp1 = std::chrono::steady_clock::now();
-    // std::chrono::duration<double> time_used_for_cmp1 = std::chrono::duration_cast<std::chrono::duration<double>>(t_after_cmp1 - t_before_cmp1);
-    // cout << "time used for cmp is: " << time_used_for_cmp1.count() << endl;
-
-
-    LWECiphertext res2 = cc.Encrypt(sk, 0);
-    int numThreads = 8;
-    int elementsPerThread = 32 / numThreads;
-    cout << "starting compare with " << numThreads << " threads..." << endl;
-    std::chrono::steady_clock::time_point t_before_cmp2 = std::chrono::steady_clock::now();
-
-
-    std::vector<std::thread> threads;
-    for (int i = 0; i < numThreads - 1; i++) {
-        int startIndex = i * elementsPerThread; // 计算起始索引
-        int endIndex = startIndex + elementsPerThread - 1; // 计算结束索引
-        // std::thread myThread(comparePart, std::ref(cc), startIndex, endIndex, std::ref(ctNum1), std::ref(ctNum2), std::ref(res2));
-        threads.emplace_back(comparePart, std::ref(cc), startIndex, endIndex, std::ref(ctNum1), std::ref(ctNum2), std::ref(res2));
-        // myThread.join();
-
-        // threads.emplace_back(comparePart, cc, startIndex, endIndex, ctNum1, ctNum2, std::ref(res));
-    }
+// res becomes an encryption of 0 if num1 equals num2, 1 otherwise
+void compare32ByBits(float num1, float num2, FhewEngine& engine, LWECiphertext& res) {
+    vector<LWECiphertext> batch;
+    compare32ByBitsBatch(&num1, &num2, 1, engine, batch);
+    res = engine.cc.EvalBinGate(OR, res, batch[0]);
+}
 
-    for (auto& thread : threads) {
-        thread.join();
+// Compares nums1[k] with nums2[k] for every k in one batch: one XOR level over all 32 * batchSize
+// bits, then five OR levels, each spread over the engine's pool. With `threshold` the bits are
+// folded by sums and functional bootstraps instead (see FhewEngine::neqThreshold).
+void compare32ByBitsBatch(const float* nums1, const float* nums2, int batchSize, FhewEngine& engine, vector<LWECiphertext>& res, bool threshold) {
+    vector<vector<LWECiphertext>> ctNums1(batchSize);
+    vector<vector<LWECiphertext>> ctNums2(batchSize);
+    for (int k = 0; k < batchSize; k++) {
+        int32_t byte1;
+        int32_t byte2;
+        memcpy(&byte1, &nums1[k], sizeof(float));
+        memcpy(&byte2, &nums2[k], sizeof(float));
+        ctNums1[k] = threshold ? engine.encryptDigits((uint32_t) byte1, 32) : engine.encryptBits((uint32_t) byte1, 32);
+        ctNums2[k] = threshold ? engine.encryptDigits((uint32_t) byte2, 32) : engine.encryptBits((uint32_t) byte2, 32);
     }
+    res = threshold ? engine.neqThreshold(ctNums1, ctNums2) : engine.neq(ctNums1, ctNums2);
+}
 
-    std::chrono::steady_clock::time_point t_after_cmp2 = std::chrono::steady_clock::now();
-    std::chrono::duration<double> time_used_for_cmp2 = std::chrono::duration_cast<std::chrono::duration<double>>(t_after_cmp2 - t_before_cmp2);
-    cout << "time used for cmp is: " << time_used_for_cmp2.count() << endl;
-
-    printBits32(byte1);
-    printBits32(byte2);
-    
-    int32_t resByte1 = 0x0000;
-    int32_t resByte2 = 0x0000;
-
-
-    LWEPlaintext resultNum1[32];
-    LWEPlaintext resultNum2[32];
-
-
-    for (int i = 31; i >= 0; i--) {
-        cc.Decrypt(sk, ctNum1[i], &resultNum1[i]);
-        cc.Decrypt(sk, ctNum2[i], &resultNum2[i]);
-        resByte1 = resByte1 << 1;
-        resByte1 = resByte1 + ((int32_t) (resultNum1[i] & 1));
-        resByte2 = resByte2 << 1;
-        resByte2 = resByte2 + ((int32_t) (resultNum2[i] & 1));
+// Digit-level EQ and LT of nums1[k] and nums2[k] by lookup tables (see FhewEngine::digitCompare).
+// The bit patterns of non-negative floats are ordered like the floats.
+void compare32ByDigitsBatch(const float* nums1, const float* nums2, int batchSize, FhewEngine& engine, int digitBits,
+                            vector<LWECiphertext>& eq, vector<LWECiphertext>& lt) {
+    vector<vector<LWECiphertext>> ctNums1(batchSize);
+    vector<vector<LWECiphertext>> ctNums2(batchSize);
+    for (int k = 0; k < batchSize; k++) {
+        int32_t byte1;
+        int32_t byte2;
+        memcpy(&byte1, &nums1[k], sizeof(float));
+        memcpy(&byte2, &nums2[k], sizeof(float));
+        ctNums1[k] = engine.encryptDigits((uint32_t) byte1, 32, digitBits);
+        ctNums2[k] = engine.encryptDigits((uint32_t) byte2, 32, digitBits);
     }
-
-    float result1;
-    float result2;
-    memcpy(&result1, &resByte1, 4);
-    memcpy(&result2, &resByte2, 4);
-    cout << "result1: " << result1 << endl;
-    cout << "result2: " << result2 << endl;
-
-
-    // return res;
+    eq = engine.digitEq(ctNums1, ctNums2, digitBits);
+    lt = engine.digitLt(ctNums1, ctNums2, digitBits);
 }
 
 int main() {
 
+    std::cout << "Please input the equality mode, `gates` for XOR and OR gates, `threshold logQ` for sum-then-threshold functional bootstrapping with a larger plaintext modulus (a larger logQ allows a larger fan-in) or `digits logQ digitBits` for lookup tables over multi-bit digits. e.g.: threshold 12" << std::endl;
+    std::string mode;
+    int logQ = 11, digitBits = 1;
+    std::cin >> mode;
+    const bool threshold = mode == "threshold";
+    const bool digits = mode == "digits";
+    if (threshold || digits) {
+        std::cin >> logQ;
+    }
+    if (digits) {
+        std::cin >> digitBits;
+    }
+
     auto cc = BinFHEContext();
 
-    cc.GenerateBinFHEContext(STD128);
+    if (threshold || digits) {
+        cc.GenerateBinFHEContext(STD128, true, logQ);
+    } else {
+        cc.GenerateBinFHEContext(STD128);
+    }
 
     auto sk = cc.KeyGen();
 
@@ -141,20 +112,81 @@ int main() {
     cc.BTKeyGen(sk);
 
     std::cout << "Completed the key generation." << std::endl;
-    
+
+    std::cout << "Please input the number of gate threads (0 for all cores) and the number of comparisons per batch. e.g.: 0 64" << std::endl;
+    int numThreads, batchSize;
+    std::cin >> numThreads >> batchSize;
+    if (numThreads <= 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // The pool is started here, outside the timed gate work.
+    FhewEngine engine(cc, sk, numThreads);
+    if (threshold) {
+        cout << "plaintext modulus " << engine.plaintextSpace() << ": " << engine.digitFanIn() << " bits per digit bootstrap, fan-in "
+             << engine.orFanIn() << " per OR bootstrap" << endl;
+        for (int bits : {32, 64}) {
+            cout << bits << "-bit compare: " << engine.thresholdGates(bits) << " bootstraps instead of " << 2 * bits - 1 << " gates" << endl;
+        }
+    }
+    if (digits) {
+        if (!engine.digitsFit(digitBits)) {
+            cout << "plaintext modulus " << engine.plaintextSpace() << " is too small for " << digitBits << "-bit digits, please use a larger logQ." << endl;
+            return 0;
+        }
+        cout << "plaintext modulus " << engine.plaintextSpace() << ": " << digitBits << "-bit digits, " << engine.digitFanIn()
+             << " digit results per combining bootstrap" << endl;
+        for (int bits : {32, 64}) {
+            cout << bits << "-bit EQ or LT: " << engine.digitGates(bits, digitBits) << " bootstraps instead of " << 2 * bits - 1 << " gates" << endl;
+        }
+    }
+
     float num1 = 1.26f;
     float num2 = 1.25f;
         
-    LWECiphertext res = cc.Encrypt(sk, 0);
+    int32_t byte1;
+    int32_t byte2;
+    memcpy(&byte1, &num1, sizeof(float));
+    memcpy(&byte2, &num2, sizeof(float));
+    printBits32(byte1);
+    printBits32(byte2);
+    if (mode == "gates") {
+        LWECiphertext res = cc.Encrypt(sk, 0);
 
+        compare32ByBits(num1, num2, engine, res);
 
-    compare32ByBits(num1, num2, cc, sk, res);
-    
-    LWEPlaintext resultcmp;
+        LWEPlaintext resultcmp;
 
-    cc.Decrypt(sk, res, &resultcmp);
+        cc.Decrypt(sk, res, &resultcmp);
+
+        std::cout << "Result of " << num1 << " != " << num2 << " = " << resultcmp << std::endl;
+    }
 
-    std::cout << "Result of ... = " << resultcmp << std::endl;
+    // Every other pair is equal.
+    vector<float> nums1(batchSize);
+    vector<float> nums2(batchSize);
+    for (int k = 0; k < batchSize; k++) {
+        nums1[k] = 1.25f + k;
+        nums2[k] = (k & 1) ? nums1[k] : nums1[k] + 0.01f;
+    }
+    engine.gateTime = 0.0;
+    engine.gates = 0;
+    vector<LWECiphertext> batch;
+    int correct = 0;
+    if (digits) {
+        vector<LWECiphertext> lt;
+        compare32ByDigitsBatch(nums1.data(), nums2.data(), batchSize, engine, digitBits, batch, lt);
+        for (int k = 0; k < batchSize; k++) {
+            correct += engine.decryptDigit(batch[k]) == (nums1[k] == nums2[k]) && engine.decryptDigit(lt[k]) == (nums1[k] < nums2[k]);
+        }
+    } else {
+        compare32ByBitsBatch(nums1.data(), nums2.data(), batchSize, engine, batch, threshold);
+        for (int k = 0; k < batchSize; k++) {
+            const int bit = threshold ? engine.decryptDigit(batch[k]) : engine.decryptBit(batch[k]);
+            correct += bit == (nums1[k] != nums2[k]);
+        }
+    }
+    cout << "Batch of " << batchSize << " comparisons on " << numThreads << " threads: " << engine.gates << " gates, gate time "
+         << engine.gateTime << ", per comparison " << engine.gateTime / batchSize << ", correct " << correct << "/" << batchSize << endl;
     
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,271 @@
+#ifndef EDB_NUMAPLACEMENT_H
+#define EDB_NUMAPLACEMENT_H
+
+#include "openfhe.h"
+
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// NUMA-aware placement of the per-modulus contexts, keys and ciphertexts.
+//
+// Every modulus is assigned to one NUMA node, balancing the EvalMult count of its EQ chain.
+// Work for a modulus runs on a driver thread pinned to the cores of its node, and OpenMP teams
+// started from that thread inherit the affinity. No libnuma is needed: the topology is read from
+// sysfs, and placement relies on the kernel's first-touch policy, so whatever a pinned thread
+// allocates (context, keys, ciphertexts) lands in the memory of its node.
+//
+// The remote ratio is measured, not estimated. move_pages(2) looks up which node every page of the
+// sampled key and ciphertext data lives on, and that node is compared with the node of the modulus.
+class NumaPlacement {
+public:
+    using T_CP = lbcrypto::Ciphertext<lbcrypto::DCRTPoly>;
+
+    struct Node {
+        int id;
+        std::vector<int> cpus;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> nodeOf;   // nodeOf[q] indexes `nodes`
+
+    NumaPlacement(const std::vector<int64_t> &moduli, int maxNodes) {
+        nodes = readNodes();
+        if (maxNodes > 0 && (int) nodes.size() > maxNodes) {
+            nodes.resize(maxNodes);
+        }
+        // Greedy: the most expensive modulus first, always onto the least loaded node.
+        std::vector<int> order(moduli.size());
+        for (size_t q = 0; q < moduli.size(); q++) {
+            order[q] = q;
+        }
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return chainCost(moduli[a]) > chainCost(moduli[b]); });
+        std::vector<int> load(nodes.size(), 0);
+        nodeOf.assign(moduli.size(), 0);
+        for (int q : order) {
+            int n = std::min_element(load.begin(), load.end()) - load.begin();
+            nodeOf[q] = n;
+            load[n] += chainCost(moduli[q]);
+        }
+        local.assign(moduli.size(), 0);
+        remote.assign(moduli.size(), 0);
+        allocBefore = allocCounters();
+    }
+
+    // Reads `none`, or `numa N` to spread the moduli over the first N nodes (0 for all of them).
+    static NumaPlacement *fromInput(std::istream &in, const std::vector<int64_t> &moduli) {
+        std::string mode;
+        in >> mode;
+        if (mode != "numa") {
+            return nullptr;
+        }
+        int maxNodes;
+        in >> maxNodes;
+        return new NumaPlacement(moduli, maxNodes);
+    }
+
+    // Runs fn(q) for every modulus on the node owning q, one pinned driver thread per node.
+    // `serial` keeps the calls mutually exclusive while still on the pinned threads, for setup
+    // code that touches OpenFHE's global context and key registries.
+    void run(const std::function<void(int)> &fn, bool serial = false) {
+        std::mutex lock;
+        std::vector<std::thread> drivers;
+        for (size_t n = 0; n < nodes.size(); n++) {
+            drivers.emplace_back([&, n]() {
+                pin(nodes[n]);
+                for (size_t q = 0; q < nodeOf.size(); q++) {
+                    if (nodeOf[q] != (int) n) {
+                        continue;
+                    }
+                    if (serial) {
+                        std::lock_guard<std::mutex> guard(lock);
+                        fn(q);
+                    } else {
+                        fn(q);
+                    }
+                }
+            });
+        }
+        for (auto &t : drivers) {
+            t.join();
+        }
+    }
+
+    // Records on which node the pages of `ct` live, compared with the node of modulus q.
+    void sample(int q, const T_CP &ct) {
+        for (const auto &element : ct -> GetElements()) {
+            samplePoly(q, element);
+        }
+    }
+
+    // Same for the relinearization keys of context `cc` that modulus q multiplies with.
+    void sampleEvalKeys(int q, const lbcrypto::CryptoContext<lbcrypto::DCRTPoly> &cc, const std::string &keyTag) {
+        for (const auto &key : cc -> GetEvalMultKeyVector(keyTag)) {
+            for (const auto &poly : key -> GetAVector()) {
+                samplePoly(q, poly);
+            }
+            for (const auto &poly : key -> GetBVector()) {
+                samplePoly(q, poly);
+            }
+        }
+    }
+
+    void report(const std::vector<int64_t> &moduli) const {
+        std::cout << "NUMA placement over " << nodes.size() << " node(s):" << std::endl
+                  << "modulus\tnode\tlocal pages\tremote pages\tremote ratio" << std::endl;
+        size_t localAll = 0, remoteAll = 0;
+        for (size_t q = 0; q < moduli.size(); q++) {
+            localAll += local[q];
+            remoteAll += remote[q];
+            std::cout << moduli[q] << "\t" << nodes[nodeOf[q]].id << "\t" << local[q] << "\t" << remote[q]
+                      << "\t" << ratio(remote[q], local[q] + remote[q]) << std::endl;
+        }
+        std::cout << "total remote ratio: " << ratio(remoteAll, localAll + remoteAll) << std::endl;
+
+        // Kernel counters of pages allocated for a task running on the node (local_node) or
+        // elsewhere (other_node), summed over the nodes, since the placement was set up.
+        std::vector<int64_t> allocAfter = allocCounters();
+        int64_t localAlloc = allocAfter[0] - allocBefore[0], otherAlloc = allocAfter[1] - allocBefore[1];
+        std::cout << "page allocations since setup: local_node " << localAlloc << ", other_node " << otherAlloc
+                  << ", remote ratio " << ratio(otherAlloc, localAlloc + otherAlloc) << std::endl;
+    }
+
+private:
+    std::vector<size_t> local, remote;
+    std::vector<int64_t> allocBefore;
+
+    static double ratio(double part, double whole) {
+        return whole > 0 ? part / whole : 0.0;
+    }
+
+    // EvalMults of the square-and-multiply chain x^(p-1).
+    static int chainCost(int64_t p) {
+        int cost = 0;
+        for (int64_t x = p - 1; x > 0; x >>= 1) {
+            cost += (x & 1) ? 2 : 1;
+        }
+        return cost;
+    }
+
+    static std::vector<int> parseCpuList(const std::string &list) {
+        std::vector<int> cpus;
+        std::stringstream s(list);
+        std::string range;
+        while (std::getline(s, range, ',')) {
+            size_t dash = range.find('-');
+            int lo = std::stoi(range.substr(0, dash));
+            int hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+            for (int c = lo; c <= hi; c++) {
+                cpus.push_back(c);
+            }
+        }
+        return cpus;
+    }
+
+    // Nodes with at least one CPU, or a single pseudo node with every CPU when sysfs has no NUMA info.
+    static std::vector<Node> readNodes() {
+        std::vector<Node> found;
+        for (int id = 0; id < 1024; id++) {
+            std::ifstream f("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            if (!f) {
+                if (id > 0 && found.size() > 0) {
+                    break;
+                }
+                continue;
+            }
+            std::string list;
+            std::getline(f, list);
+            if (!list.empty()) {
+                found.push_back({id, parseCpuList(list)});
+            }
+        }
+        if (found.empty()) {
+            Node all = {0, {}};
+            for (unsigned c = 0; c < std::thread::hardware_concurrency(); c++) {
+                all.cpus.push_back(c);
+            }
+            found.push_back(all);
+        }
+        return found;
+    }
+
+    static void pin(const Node &node) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : node.cpus) {
+            CPU_SET(c, &set);
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            std::cerr << "Cannot pin to NUMA node " << node.id << std::endl;
+        }
+#ifdef _OPENMP
+        omp_set_num_threads(node.cpus.size());
+#endif
+    }
+
+    void samplePoly(int q, const lbcrypto::DCRTPoly &poly) {
+        const long pageSize = sysconf(_SC_PAGESIZE);
+        std::vector<void *> pages;
+        for (const auto &tower : poly.GetAllElements()) {
+            const auto &values = tower.GetValues();
+            if (values.GetLength() == 0) {
+                continue;
+            }
+            uintptr_t begin = (uintptr_t) &values[0];
+            uintptr_t end = begin + values.GetLength() * sizeof(values[0]);
+            for (uintptr_t p = begin & ~(uintptr_t) (pageSize - 1); p < end; p += pageSize) {
+                pages.push_back((void *) p);
+            }
+        }
+        std::vector<int> status(pages.size(), -1);
+        // With a null node list move_pages only reports the node each page currently lives on.
+        if (pages.empty() || syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0) {
+            return;
+        }
+        for (int node : status) {
+            if (node < 0) {
+                continue;
+            }
+            if (node == nodes[nodeOf[q]].id) {
+                local[q]++;
+            } else {
+                remote[q]++;
+            }
+        }
+    }
+
+    // {local_node, other_node} summed over all nodes.
+    std::vector<int64_t> allocCounters() const {
+        std::vector<int64_t> sum(2, 0);
+        for (const auto &node : nodes) {
+            std::ifstream f("/sys/devices/system/node/node" + std::to_string(node.id) + "/numastat");
+            std::string name;
+            int64_t value;
+            while (f >> name >> value) {
+                if (name == "local_node") {
+                    sum[0] += value;
+                } else if (name == "other_node") {
+                    sum[1] += value;
+                }
+            }
+        }
+        return sum;
+    }
+};
+
+#endif
@@ -0,0 +1,355 @@
+#include "openfhe.h"
+#include "ciphertext-ser.h"
+#include "scheme/bfvrns/bfvrns-ser.h"
+#include "seededEncryption.h"
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <cstdint>
+
+using namespace lbcrypto;
+using T_CP = Ciphertext<DCRTPoly>;
+
+using std::cout;
+using std::cin;
+using std::endl;
+using std::string;
+using std::vector;
+
+// SIMD packing needs p = 1 mod 2n, so the packed store uses the NTT-friendly CRT moduli of crtEQTestSIMD.
+const int crtModulusNumber = 2;
+const vector<int64_t> crtModulusVector = {65537, 786433};
+CryptoContext<DCRTPoly> cc[crtModulusNumber];
+KeyPair<DCRTPoly> keyPair[crtModulusNumber];
+int slots;
+int64_t ctBytes[crtModulusNumber];   // serialized size of a store ciphertext under modulus q
+
+// Encrypted column store. Records are packed row-major into blocks of `slots` rows:
+// block[b][j][q] holds column j of rows [b * slots, (b + 1) * slots) under modulus q.
+// Column `columnNum` is the validity column, 1 for a live row and 0 for a deleted or unused slot.
+// Appended rows wait in appendBuffer, each already placed in its target slot, and are packed
+// into the tail block when the buffer is flushed.
+// Write amplification is reported per changed row at two levels: the plaintext slots rewritten
+// (a whole column block for re-encryption, one row for a masked delta) and the store ciphertexts
+// and bytes rewritten, where a masked delta is no cheaper since its EvalAdd still rewrites the
+// whole ciphertext. Deltas and re-encrypted blocks are uploaded with seeded encryption, so the
+// upload is half a ciphertext per modulus and column either way.
+struct PackedColumnStore {
+    int columnNum;
+    int64_t rowNum;
+    vector<vector<vector<T_CP>>> block;
+    vector<vector<vector<T_CP>>> appendBuffer;
+    int64_t slotsWritten;
+    int64_t ctWritten;
+    int64_t bytesWritten;
+    int64_t uploadBytes;
+    int64_t rowsChanged;
+};
+
+bool initCcSIMD();
+int64_t centered(int64_t val, int64_t modulus);
+T_CP encryptSlot(PackedColumnStore &store, int64_t val, int slot, int q);
+void resetWrites(PackedColumnStore &store);
+void buildStore(PackedColumnStore &store, const vector<vector<int64_t>> &table);
+void countWrite(PackedColumnStore &store, int q);
+void reportWrites(const string &name, const PackedColumnStore &store);
+void updateRow(PackedColumnStore &store, vector<vector<int64_t>> &table, int64_t row, int j, int64_t newVal);
+void deleteRow(PackedColumnStore &store, vector<vector<int64_t>> &table, int64_t row);
+void appendRow(PackedColumnStore &store, vector<vector<int64_t>> &table, const vector<int64_t> &record, int bufferSize);
+void flushAppendBuffer(PackedColumnStore &store);
+void reencryptColumn(PackedColumnStore &store, const vector<vector<int64_t>> &table, int64_t row, int j);
+bool checkStore(const PackedColumnStore &store, const vector<vector<int64_t>> &table, int samples);
+
+
+bool initCcSIMD() {
+    for (int i = 0; i < crtModulusNumber; i++) {
+        const int64_t modulus = crtModulusVector[i];
+        CCParams<CryptoContextBFVRNS> parameters;
+        parameters.SetMultiplicativeDepth(floor(log2(modulus)));
+        parameters.SetPlaintextModulus(modulus);
+        cc[i] = GenCryptoContext(parameters);
+        cc[i]->Enable(PKE);
+        cc[i]->Enable(KEYSWITCH);
+        cc[i]->Enable(LEVELEDSHE);
+        keyPair[i] = cc[i]->KeyGen();
+        cc[i]->EvalMultKeyGen(keyPair[i].secretKey);
+    }
+    // every context must give the same slot count, the packed layout is shared by all moduli
+    slots = cc[0]->GetRingDimension();
+    for (int i = 1; i < crtModulusNumber; i++) {
+        if ((int) cc[i]->GetRingDimension() != slots) {
+            cout << "Ring dimension " << cc[i]->GetRingDimension() << " of modulus " << i << " differs from " << slots
+                 << " of modulus 0, the packed layout needs one slot count." << endl;
+            return false;
+        }
+    }
+    cout << "CryptoContext and KeyPair generatation is done, " << slots << " slots per ciphertext." << endl;
+    return true;
+}
+
+int main() {
+    cout << "This program evals slot-level UPDATE/DELETE/APPEND on SIMD packed encrypted columns." << endl
+         << "Please input record number, column number, number of updates, deletes and appends, and the append buffer size. e.g.: 32768 2 100 10 100 64" << endl;
+    int64_t tau;
+    int columnNum, numUpdate, numDelete, numAppend, bufferSize;
+    cin >> tau >> columnNum >> numUpdate >> numDelete >> numAppend >> bufferSize;
+    if (tau <= 0 || columnNum <= 0 || bufferSize <= 0) {
+        cout << "incorrect parameter, please retry." << endl;
+        return 0;
+    }
+
+    if (!initCcSIMD()) {
+        return 0;
+    }
+
+    std::default_random_engine dre;
+    dre.seed(time(0));
+    std::uniform_int_distribution<int64_t> u = std::uniform_int_distribution<int64_t>(0, UINT32_MAX);
+
+    // table[i] is the plaintext mirror kept by the data owner, with the validity flag as last column.
+    vector<vector<int64_t>> table(tau, vector<int64_t>(columnNum + 1, 1));
+    for (int64_t i = 0; i < tau; i++) {
+        for (int j = 0; j < columnNum; j++) {
+            table[i][j] = u(dre);
+        }
+    }
+
+    PackedColumnStore store;
+    store.columnNum = columnNum;
+    buildStore(store, table);
+    cout << "Data generation and encryption is done, " << store.block.size() << " block(s)." << endl;
+
+    // Baseline: changing one row by re-encrypting the whole column under every modulus.
+    {
+        std::chrono::steady_clock::time_point t_before = std::chrono::steady_clock::now();
+        int64_t row = std::uniform_int_distribution<int64_t>(0, tau - 1)(dre);
+        table[row][0] = u(dre);
+        reencryptColumn(store, table, row, 0);
+        std::chrono::steady_clock::time_point t_after = std::chrono::steady_clock::now();
+        std::chrono::duration<double> time_used = std::chrono::duration_cast<std::chrono::duration<double>>(t_after - t_before);
+        cout << "Re-encrypting update time: " << time_used.count() << endl;
+        reportWrites("Re-encrypting", store);
+    }
+
+    resetWrites(store);
+    std::chrono::steady_clock::time_point t_update_before = std::chrono::steady_clock::now();
+    for (int k = 0; k < numUpdate; k++) {
+        int64_t row = std::uniform_int_distribution<int64_t>(0, tau - 1)(dre);
+        int j = std::uniform_int_distribution<int>(0, columnNum - 1)(dre);
+        updateRow(store, table, row, j, u(dre));
+    }
+    for (int k = 0; k < numDelete; k++) {
+        int64_t row = std::uniform_int_distribution<int64_t>(0, tau - 1)(dre);
+        deleteRow(store, table, row);
+    }
+    std::chrono::steady_clock::time_point t_update_after = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_update = std::chrono::duration_cast<std::chrono::duration<double>>(t_update_after - t_update_before);
+    cout << "Masked delta update/delete time: " << time_used_for_update.count()
+         << ", per row: " << time_used_for_update.count() / std::max(numUpdate + numDelete, 1) << endl;
+
+    std::chrono::steady_clock::time_point t_append_before = std::chrono::steady_clock::now();
+    for (int k = 0; k < numAppend; k++) {
+        vector<int64_t> record(columnNum + 1, 1);
+        for (int j = 0; j < columnNum; j++) {
+            record[j] = u(dre);
+        }
+        appendRow(store, table, record, bufferSize);
+    }
+    flushAppendBuffer(store);
+    std::chrono::steady_clock::time_point t_append_after = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_append = std::chrono::duration_cast<std::chrono::duration<double>>(t_append_after - t_append_before);
+    cout << "Append time: " << time_used_for_append.count()
+         << ", per row: " << time_used_for_append.count() / std::max(numAppend, 1) << endl;
+
+    if (store.rowsChanged > 0) {
+        reportWrites("Masked delta", store);
+    }
+    cout << "Store check: " << (checkStore(store, table, 16) ? "correct" : "mismatch") << endl;
+    return 0;
+}
+
+int64_t centered(int64_t val, int64_t modulus) {
+    val %= modulus;
+    if (val < 0) {
+        val += modulus;
+    }
+    return val > modulus / 2 ? val - modulus : val;
+}
+
+// Encrypts `val` into a single slot, all other slots are 0. This is the one-hot masked delta,
+// uploaded in seeded form and expanded by the server.
+T_CP encryptSlot(PackedColumnStore &store, int64_t val, int slot, int q) {
+    vector<int64_t> v(slot + 1, 0);
+    v[slot] = centered(val, crtModulusVector[q]);
+    Plaintext pt = cc[q] -> MakePackedPlaintext(v);
+    string msg = seededEncrypt(cc[q], keyPair[q].secretKey, pt);
+    store.uploadBytes += msg.size();
+    return seededExpand(msg);
+}
+
+void buildStore(PackedColumnStore &store, const vector<vector<int64_t>> &table) {
+    store.rowNum = table.size();
+    resetWrites(store);
+    const int64_t blockNum = (store.rowNum + slots - 1) / slots;
+    store.block.assign(blockNum, vector<vector<T_CP>>(store.columnNum + 1, vector<T_CP>(crtModulusNumber)));
+    for (int64_t b = 0; b < blockNum; b++) {
+        for (int j = 0; j <= store.columnNum; j++) {
+            for (int q = 0; q < crtModulusNumber; q++) {
+                vector<int64_t> v(slots, 0);
+                for (int s = 0; s < slots && b * slots + s < store.rowNum; s++) {
+                    v[s] = centered(table[b * slots + s][j], crtModulusVector[q]);
+                }
+                Plaintext pt = cc[q] -> MakePackedPlaintext(v);
+                store.block[b][j][q] = cc[q] -> Encrypt(keyPair[q].publicKey, pt);
+            }
+        }
+    }
+    for (int q = 0; q < crtModulusNumber; q++) {
+        std::stringstream s;
+        Serial::Serialize(store.block[0][0][q], s, SerType::BINARY);
+        ctBytes[q] = s.str().size();
+    }
+}
+
+void resetWrites(PackedColumnStore &store) {
+    store.slotsWritten = 0;
+    store.ctWritten = 0;
+    store.bytesWritten = 0;
+    store.uploadBytes = 0;
+    store.rowsChanged = 0;
+}
+
+void countWrite(PackedColumnStore &store, int q) {
+    store.ctWritten++;
+    store.bytesWritten += ctBytes[q];
+}
+
+void reportWrites(const string &name, const PackedColumnStore &store) {
+    cout << name << " write amplification per changed row: " << (double) store.slotsWritten / store.rowsChanged << " slots, "
+         << (double) store.ctWritten / store.rowsChanged << " ciphertexts, " << (double) store.bytesWritten / store.rowsChanged
+         << " bytes rewritten, " << (double) store.uploadBytes / store.rowsChanged << " bytes uploaded" << endl;
+}
+
+void reencryptColumn(PackedColumnStore &store, const vector<vector<int64_t>> &table, int64_t row, int j) {
+    const int64_t b = row / slots;
+    for (int q = 0; q < crtModulusNumber; q++) {
+        vector<int64_t> v(slots, 0);
+        for (int s = 0; s < slots && b * slots + s < store.rowNum; s++) {
+            v[s] = centered(table[b * slots + s][j], crtModulusVector[q]);
+        }
+        Plaintext pt = cc[q] -> MakePackedPlaintext(v);
+        string msg = seededEncrypt(cc[q], keyPair[q].secretKey, pt);
+        store.uploadBytes += msg.size();
+        store.block[b][j][q] = seededExpand(msg);
+        countWrite(store, q);
+    }
+    store.slotsWritten += slots;
+    store.rowsChanged++;
+}
+
+// Client: Enc((newVal - oldVal) * e_row) per modulus. Server: one EvalAdd per modulus.
+void updateRow(PackedColumnStore &store, vector<vector<int64_t>> &table, int64_t row, int j, int64_t newVal) {
+    const int64_t b = row / slots;
+    const int s = row % slots;
+    for (int q = 0; q < crtModulusNumber; q++) {
+        T_CP delta = encryptSlot(store, newVal - table[row][j], s, q);
+        store.block[b][j][q] = cc[q] -> EvalAdd(store.block[b][j][q], delta);
+        countWrite(store, q);
+    }
+    table[row][j] = newVal;
+    store.slotsWritten++;
+    store.rowsChanged++;
+}
+
+// A delete is the masked delta that zeroes every column of the row, including its validity flag.
+void deleteRow(PackedColumnStore &store, vector<vector<int64_t>> &table, int64_t row) {
+    if (table[row][store.columnNum] == 0) {
+        return;
+    }
+    const int64_t b = row / slots;
+    const int s = row % slots;
+    for (int j = 0; j <= store.columnNum; j++) {
+        for (int q = 0; q < crtModulusNumber; q++) {
+            T_CP delta = encryptSlot(store, -table[row][j], s, q);
+            store.block[b][j][q] = cc[q] -> EvalAdd(store.block[b][j][q], delta);
+            countWrite(store, q);
+        }
+        table[row][j] = 0;
+    }
+    store.slotsWritten++;
+    store.rowsChanged++;
+}
+
+// The client encrypts the new row directly into its target slot, so the server never needs
+// rotation keys to pack the buffer.
+void appendRow(PackedColumnStore &store, vector<vector<int64_t>> &table, const vector<int64_t> &record, int bufferSize) {
+    const int64_t row = store.rowNum + store.appendBuffer.size();
+    const int s = row % slots;
+    vector<vector<T_CP>> ct(store.columnNum + 1, vector<T_CP>(crtModulusNumber));
+    for (int j = 0; j <= store.columnNum; j++) {
+        for (int q = 0; q < crtModulusNumber; q++) {
+            ct[j][q] = encryptSlot(store, record[j], s, q);
+        }
+    }
+    store.appendBuffer.push_back(ct);
+    table.push_back(record);
+    store.slotsWritten++;
+    store.rowsChanged++;
+    // A block boundary also forces a flush, so every buffered row lands in the same tail block.
+    if ((int) store.appendBuffer.size() >= bufferSize || s == slots - 1) {
+        flushAppendBuffer(store);
+    }
+}
+
+void flushAppendBuffer(PackedColumnStore &store) {
+    if (store.appendBuffer.empty()) {
+        return;
+    }
+    const int64_t b = store.rowNum / slots;
+    if (b == (int64_t) store.block.size()) {
+        store.block.push_back(store.appendBuffer[0]);
+    } else {
+        for (int j = 0; j <= store.columnNum; j++) {
+            for (int q = 0; q < crtModulusNumber; q++) {
+                store.block[b][j][q] = cc[q] -> EvalAdd(store.block[b][j][q], store.appendBuffer[0][j][q]);
+            }
+        }
+    }
+    for (int j = 0; j <= store.columnNum; j++) {
+        for (int q = 0; q < crtModulusNumber; q++) {
+            countWrite(store, q);
+        }
+    }
+    for (size_t k = 1; k < store.appendBuffer.size(); k++) {
+        for (int j = 0; j <= store.columnNum; j++) {
+            for (int q = 0; q < crtModulusNumber; q++) {
+                store.block[b][j][q] = cc[q] -> EvalAdd(store.block[b][j][q], store.appendBuffer[k][j][q]);
+                countWrite(store, q);
+            }
+        }
+    }
+    store.rowNum += store.appendBuffer.size();
+    store.appendBuffer.clear();
+}
+
+bool checkStore(const PackedColumnStore &store, const vector<vector<int64_t>> &table, int samples) {
+    std::default_random_engine dre;
+    dre.seed(time(0));
+    std::uniform_int_distribution<int64_t> u = std::uniform_int_distribution<int64_t>(0, store.rowNum - 1);
+    for (int k = 0; k < samples; k++) {
+        int64_t row = (k == 0) ? store.rowNum - 1 : u(dre);
+        for (int j = 0; j <= store.columnNum; j++) {
+            for (int q = 0; q < crtModulusNumber; q++) {
+                Plaintext pt;
+                cc[q] -> Decrypt(keyPair[q].secretKey, store.block[row / slots][j][q], &pt);
+                int64_t val = pt -> GetPackedValue()[row % slots];
+                if (centered(val, crtModulusVector[q]) != centered(table[row][j], crtModulusVector[q])) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,227 @@
+#include "openfhe.h"
+#include "pdqNet.h"
+#include "utils/prng/blake2engine.h"
+#include <array>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+
+using namespace lbcrypto;
+using T_CP = Ciphertext<DCRTPoly>;
+
+using std::cout;
+using std::cin;
+using std::endl;
+using std::string;
+using std::vector;
+
+// Opaque id of the condition "column j equals the value at ptRnsData[row][offset...]" for the
+// server's condition cache: 128 bits of a PRF keyed with a 256-bit client secret, so the server
+// cannot link it to a value. Blake2 is seeded with the key, j and the residues, which are centred,
+// so they are shifted back to [0, p) and packed two 16-bit residues per word.
+string predicateId(const std::array<uint32_t, 8> &key, int j, const vector<int64_t> &rnsValues, int offset) {
+    std::array<uint32_t, 16> seed = {};
+    std::copy(key.begin(), key.end(), seed.begin());
+    seed[key.size()] = j;
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        const uint32_t residue = (uint32_t) (rnsValues[offset + q] + rnsModulusVector[q] / 2) & 0xFFFF;
+        seed[key.size() + 1 + q / 2] |= residue << (16 * (q & 1));
+    }
+    default_prng::Blake2Engine engine(seed);
+    std::stringstream s;
+    s << std::hex << std::setfill('0');
+    for (int w = 0; w < 4; w++) {
+        s << std::setw(8) << engine();
+    }
+    return s.str();
+}
+
+// The client plays data owner and querier and is the only party holding the secret keys.
+CryptoContext<DCRTPoly> cc[rnsModulusNumber];
+KeyPair<DCRTPoly> keyPair[rnsModulusNumber];
+
+
+void initCcNoSIMD() {
+    for (int i = 0; i < rnsModulusNumber; i++) {
+        const int modulus = rnsModulusVector[i];
+        CCParams<CryptoContextBFVRNS> parameters;
+        parameters.SetMultiplicativeDepth(floor(log2(modulus)) + 4);
+        parameters.SetPlaintextModulus(modulus);
+        cc[i] = GenCryptoContext(parameters);
+        cc[i]->Enable(PKE);
+        cc[i]->Enable(KEYSWITCH);
+        cc[i]->Enable(LEVELEDSHE);
+        keyPair[i] = cc[i]->KeyGen();
+        cc[i]->EvalMultKeyGen(keyPair[i].secretKey);
+    }
+    cout << "CryptoContext and KeyPair generatation is done." << endl;
+}
+
+int main() {
+    cout << "This program is the client of the Private Database Query protocol." << endl
+         << "Please input the server address, record number, number of equality query conditions, number of queries and number of distinct query rows (0 for a random row per query). e.g.: /tmp/pdq.sock 10 2 5 2" << endl;
+    string addr;
+    int tau, numEq, numQuery, numDistinct;
+    cin >> addr >> tau >> numEq >> numQuery >> numDistinct;
+    const int columnNum = numEq + 1;
+
+    PdqConn conn;
+    conn.fd = pdqConnect(addr);
+    if (conn.fd < 0) {
+        return 1;
+    }
+
+    initCcNoSIMD();
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        std::stringstream s;
+        Serial::Serialize(cc[q], s, SerType::BINARY);
+        Serial::Serialize(keyPair[q].publicKey, s, SerType::BINARY);
+        cc[q] -> SerializeEvalMultKey(s, SerType::BINARY, keyPair[q].secretKey -> GetKeyTag());
+        sendMsg(conn, MSG_SETUP, s.str());
+    }
+    const size_t setupBytes = conn.bytesSent;
+
+    // Generate random data, encrypt and upload it record by record.
+    vector<vector<int64_t>> ptRnsData(tau, vector<int64_t>(columnNum * rnsModulusNumber));
+    {
+        std::default_random_engine dre;
+        dre.seed(time(0));
+        std::uniform_int_distribution<int64_t> u = std::uniform_int_distribution<int64_t>(0, plaintextModulus);
+
+        sendMsg(conn, MSG_TABLE, std::to_string(tau) + " " + std::to_string(columnNum));
+        vector<int64_t> tmp(1);
+        for (int i = 0; i < tau; i++) {
+            std::stringstream s;
+            for (int j = 0; j < columnNum; j++) {
+                int64_t num = u(dre);
+                for (int q = 0; q < rnsModulusNumber; q++) {
+                    int64_t rns_val = (num % (rnsModulusVector[q])) - rnsModulusVector[q] / 2;
+                    ptRnsData[i][j * rnsModulusNumber + q] = rns_val;
+                    tmp[0] = rns_val;
+                    Plaintext pt = cc[q] -> MakeCoefPackedPlaintext(tmp);
+                    writeCiphertext(s, cc[q] -> Encrypt(keyPair[q].publicKey, pt));
+                }
+            }
+            sendMsg(conn, MSG_RECORD, s.str());
+        }
+        cout << "Data generation, encryption and upload is done, setup " << setupBytes << " bytes, table "
+             << conn.bytesSent - setupBytes << " bytes." << endl;
+    }
+
+    // Each query is the condition of a random record, drawn from `numDistinct` rows to model a
+    // dashboard that re-issues the same predicates. Latency is split into the client encoding,
+    // the transfer (round trip minus what the server reports), server evaluation and decryption.
+    std::default_random_engine dre;
+    dre.seed(time(0));
+    std::array<uint32_t, 8> predicateKey;
+    std::random_device rd;
+    for (auto &w : predicateKey) {
+        w = rd();
+    }
+    // Two conditions that differ only in an odd residue next to a negative even one must not share
+    // a cache entry.
+    {
+        vector<int64_t> a(rnsModulusNumber, -1), b(rnsModulusNumber, -1);
+        b[1] = 1;
+        if (predicateId(predicateKey, 0, a, 0) == predicateId(predicateKey, 0, b, 0)) {
+            cout << "Predicate id check failed: distinct conditions share an id." << endl;
+            return 1;
+        }
+    }
+    vector<int> distinctRows;
+    for (int k = 0; k < numDistinct; k++) {
+        distinctRows.push_back(std::uniform_int_distribution<int>(0, tau - 1)(dre));
+    }
+    double encodeTime = 0.0, transferTime = 0.0, evalTime = 0.0, decryptTime = 0.0;
+    size_t querySent = 0, resultReceived = 0;
+    size_t checked = 0, mismatched = 0;
+    for (int k = 0; k < numQuery; k++) {
+        const int row = numDistinct > 0 ? distinctRows[std::uniform_int_distribution<int>(0, numDistinct - 1)(dre)]
+                                         : std::uniform_int_distribution<int>(0, tau - 1)(dre);
+
+        std::chrono::steady_clock::time_point t_encode_before = std::chrono::steady_clock::now();
+        std::stringstream s;
+        s << numEq;
+        for (int j = 0; j < numEq; j++) {
+            s << " " << predicateId(predicateKey, j, ptRnsData[row], j * rnsModulusNumber);
+        }
+        s << "\n";
+        vector<int64_t> tmp(1);
+        for (int j = 0; j < numEq; j++) {
+            for (int q = 0; q < rnsModulusNumber; q++) {
+                tmp[0] = ptRnsData[row][j * rnsModulusNumber + q];
+                Plaintext pt = cc[q] -> MakeCoefPackedPlaintext(tmp);
+                writeCiphertext(s, cc[q] -> Encrypt(keyPair[q].publicKey, pt));
+            }
+        }
+        string query = s.str();
+        std::chrono::steady_clock::time_point t_encode_after = std::chrono::steady_clock::now();
+
+        const size_t sentBefore = conn.bytesSent, receivedBefore = conn.bytesReceived;
+        sendMsg(conn, MSG_QUERY, query);
+        uint32_t type;
+        string payload;
+        if (!recvMsg(conn, type, payload) || type != MSG_RESULT) {
+            cout << "Connection to the server lost." << endl;
+            return 1;
+        }
+        std::chrono::steady_clock::time_point t_transfer_after = std::chrono::steady_clock::now();
+        querySent += conn.bytesSent - sentBefore;
+        resultReceived += conn.bytesReceived - receivedBefore;
+
+        double times[2];
+        memcpy(times, payload.data(), sizeof(times));
+        std::stringstream in(payload.substr(sizeof(times)));
+        vector<Plaintext> result(tau * rnsModulusNumber);
+        for (int i = 0; i < tau; i++) {
+            for (int q = 0; q < rnsModulusNumber; q++) {
+                T_CP ct = readCiphertext(in);
+                cc[q] -> Decrypt(keyPair[q].secretKey, ct, &result[i * rnsModulusNumber + q]);
+            }
+        }
+        std::chrono::steady_clock::time_point t_decrypt_after = std::chrono::steady_clock::now();
+
+        // Plaintext query: per modulus, a record returns its value residue when all its
+        // condition residues equal the query's, and 0 otherwise.
+        for (int i = 0; i < tau; i++) {
+            for (int q = 0; q < rnsModulusNumber; q++) {
+                bool match = true;
+                for (int j = 0; j < numEq; j++) {
+                    match = match && ptRnsData[i][j * rnsModulusNumber + q] == ptRnsData[row][j * rnsModulusNumber + q];
+                }
+                const int64_t expected = match ? ptRnsData[i][numEq * rnsModulusNumber + q] : 0;
+                checked++;
+                mismatched += result[i * rnsModulusNumber + q] -> GetCoefPackedValue()[0] != expected;
+            }
+        }
+
+        std::chrono::duration<double> roundTrip = t_transfer_after - t_encode_after;
+        std::chrono::duration<double> encode = t_encode_after - t_encode_before;
+        std::chrono::duration<double> decrypt = t_decrypt_after - t_transfer_after;
+        encodeTime += encode.count();
+        transferTime += roundTrip.count() - times[0] - times[1];
+        evalTime += times[0];
+        decryptTime += decrypt.count();
+    }
+    sendMsg(conn, MSG_BYE, "");
+    close(conn.fd);
+
+    cout << "Result check against the plaintext queries: " << checked - mismatched << "/" << checked << " residues correct" << endl;
+    if (mismatched > 0) {
+        cout << "The server's results do not match the plaintext queries." << endl;
+        return 1;
+    }
+
+    if (numQuery > 0) {
+        cout << "Average query latency breakdown:" << endl
+             << "encode: " << encodeTime / numQuery << endl
+             << "transfer: " << transferTime / numQuery << endl
+             << "evaluate: " << evalTime / numQuery << endl
+             << "decrypt: " << decryptTime / numQuery << endl
+             << "total: " << (encodeTime + transferTime + evalTime + decryptTime) / numQuery << endl;
+        cout << "Average query bytes: " << querySent / numQuery << ", average response bytes: " << resultReceived / numQuery << endl;
+    }
+    return 0;
+}
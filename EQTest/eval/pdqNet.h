@@ -0,0 +1,171 @@
+#ifndef EDB_PDQNET_H
+#define EDB_PDQNET_H
+
+#include "openfhe.h"
+
+// header files needed for serialization
+#include "ciphertext-ser.h"
+#include "cryptocontext-ser.h"
+#include "key/key-ser.h"
+#include "scheme/bfvrns/bfvrns-ser.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Wire protocol between the PDQ client (data owner and querier, holds the secret key) and the
+// PDQ server (holds the contexts, public and evaluation keys and the encrypted store).
+//
+// Every message is a frame: 4 bytes type, 8 bytes payload length, payload. Payloads that carry
+// ciphertexts are the BINARY serializations of the ciphertexts one after another.
+//   MSG_SETUP   one per modulus: context, public key and eval mult key
+//   MSG_TABLE   text "tau columnNum", followed by one MSG_RECORD per record
+//   MSG_RECORD  columnNum * rnsModulusNumber ciphertexts, column major per modulus
+//   MSG_QUERY   text "numEq id_1 ... id_numEq" line, then numEq * rnsModulusNumber ciphertexts.
+//               id_j is an opaque predicate id for the server's condition cache, `-` for none
+//   MSG_RESULT  evaluate and server I/O time as two doubles, then tau * rnsModulusNumber ciphertexts
+//   MSG_BYE     empty, ends the session
+//   MSG_SHARD_QUERY  text "numEq" line, then the ciphertexts as in MSG_QUERY, sent by the
+//                    coordinator to every worker of a sharded store
+//   MSG_PARTIAL      evaluate and server I/O time as two doubles, then the partial COUNT and SUM
+//                    (rnsModulusNumber ciphertexts each) and one result per record of the shard
+
+const int64_t plaintextModulus = 4294967311;
+const int rnsModulusNumber = 8;
+const std::vector<int64_t> rnsModulusVector = {7, 11, 13, 17, 19, 23, 29, 31};
+
+enum PdqMessage : uint32_t { MSG_SETUP = 1, MSG_TABLE, MSG_RECORD, MSG_QUERY, MSG_RESULT, MSG_BYE,
+                             MSG_SHARD_QUERY, MSG_PARTIAL };
+
+// A connected socket with its byte counters and the time spent inside send/recv.
+struct PdqConn {
+    int fd = -1;
+    size_t bytesSent = 0;
+    size_t bytesReceived = 0;
+    double ioTime = 0.0;
+};
+
+// An address containing ':' is a loopback TCP "host:port", anything else a Unix-domain socket path.
+inline int pdqSocket(const std::string &addr, sockaddr_storage &sa, socklen_t &len) {
+    memset(&sa, 0, sizeof(sa));
+    size_t colon = addr.rfind(':');
+    if (colon == std::string::npos) {
+        sockaddr_un *un = (sockaddr_un *) &sa;
+        un->sun_family = AF_UNIX;
+        strncpy(un->sun_path, addr.c_str(), sizeof(un->sun_path) - 1);
+        len = sizeof(sockaddr_un);
+        return socket(AF_UNIX, SOCK_STREAM, 0);
+    }
+    sockaddr_in *in = (sockaddr_in *) &sa;
+    in->sin_family = AF_INET;
+    in->sin_port = htons(std::stoi(addr.substr(colon + 1)));
+    inet_pton(AF_INET, addr.substr(0, colon).c_str(), &in->sin_addr);
+    len = sizeof(sockaddr_in);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    return fd;
+}
+
+inline int pdqListen(const std::string &addr) {
+    sockaddr_storage sa;
+    socklen_t len;
+    int fd = pdqSocket(addr, sa, len);
+    if (addr.find(':') == std::string::npos) {
+        unlink(addr.c_str());
+    }
+    if (fd < 0 || bind(fd, (sockaddr *) &sa, len) < 0 || listen(fd, 16) < 0) {
+        std::cerr << "Error listening on " << addr << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    return fd;
+}
+
+inline int pdqConnect(const std::string &addr) {
+    sockaddr_storage sa;
+    socklen_t len;
+    int fd = pdqSocket(addr, sa, len);
+    if (fd < 0 || connect(fd, (sockaddr *) &sa, len) < 0) {
+        std::cerr << "Error connecting to " << addr << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    return fd;
+}
+
+inline bool pdqWriteAll(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+inline bool pdqReadAll(int fd, char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+inline bool sendMsg(PdqConn &conn, uint32_t type, const std::string &payload) {
+    std::chrono::steady_clock::time_point t_before = std::chrono::steady_clock::now();
+    char header[12];
+    uint64_t len = payload.size();
+    memcpy(header, &type, 4);
+    memcpy(header + 4, &len, 8);
+    bool ok = pdqWriteAll(conn.fd, header, sizeof(header)) && pdqWriteAll(conn.fd, payload.data(), payload.size());
+    std::chrono::duration<double> time_used = std::chrono::steady_clock::now() - t_before;
+    conn.ioTime += time_used.count();
+    conn.bytesSent += sizeof(header) + payload.size();
+    return ok;
+}
+
+inline bool recvMsg(PdqConn &conn, uint32_t &type, std::string &payload) {
+    std::chrono::steady_clock::time_point t_before = std::chrono::steady_clock::now();
+    char header[12];
+    uint64_t len;
+    if (!pdqReadAll(conn.fd, header, sizeof(header))) {
+        return false;
+    }
+    memcpy(&type, header, 4);
+    memcpy(&len, header + 4, 8);
+    payload.resize(len);
+    bool ok = pdqReadAll(conn.fd, &payload[0], len);
+    std::chrono::duration<double> time_used = std::chrono::steady_clock::now() - t_before;
+    conn.ioTime += time_used.count();
+    conn.bytesReceived += sizeof(header) + len;
+    return ok;
+}
+
+inline void writeCiphertext(std::ostream &os, const lbcrypto::Ciphertext<lbcrypto::DCRTPoly> &ct) {
+    lbcrypto::Serial::Serialize(ct, os, lbcrypto::SerType::BINARY);
+}
+
+inline lbcrypto::Ciphertext<lbcrypto::DCRTPoly> readCiphertext(std::istream &is) {
+    lbcrypto::Ciphertext<lbcrypto::DCRTPoly> ct;
+    lbcrypto::Serial::Deserialize(ct, is, lbcrypto::SerType::BINARY);
+    return ct;
+}
+
+#endif
@@ -0,0 +1,236 @@
+#include "openfhe.h"
+#include "pdqNet.h"
+#include "conditionCache.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+
+using namespace lbcrypto;
+using T_CP = Ciphertext<DCRTPoly>;
+
+using std::cout;
+using std::cin;
+using std::endl;
+using std::string;
+using std::vector;
+
+// The server never sees a secret key: it holds the contexts, public keys and eval mult keys
+// received in MSG_SETUP and the encrypted store received in MSG_TABLE/MSG_RECORD.
+CryptoContext<DCRTPoly> cc[rnsModulusNumber];
+PublicKey<DCRTPoly> publicKey[rnsModulusNumber];
+int tau = 0;
+int columnNum = 0;
+vector<vector<T_CP>> ctRnsData;   // ctRnsData[i][j * rnsModulusNumber + q]
+uint64_t tableVersion = 0;        // bumped by every change to the table
+ConditionCache *conditionCache = nullptr;
+
+
+T_CP rns_eq(const T_CP &op1, const T_CP &op2, int q);
+void serveClient(PdqConn &conn);
+bool evalQuery(const string &payload, string &response);
+
+
+int main() {
+    cout << "This program is the server of the Private Database Query protocol." << endl
+         << "Please input the address to listen on, a Unix-domain socket path or a loopback host:port, and the condition cache budget in MB (0 disables it). e.g.: /tmp/pdq.sock 256  or 127.0.0.1:5555 0" << endl;
+    string addr;
+    size_t cacheMB;
+    cin >> addr >> cacheMB;
+    if (cacheMB > 0) {
+        conditionCache = new ConditionCache(cacheMB << 20);
+    }
+    int fd = pdqListen(addr);
+    if (fd < 0) {
+        return 1;
+    }
+    cout << "Listening on " << addr << endl;
+
+    while (true) {
+        PdqConn conn;
+        conn.fd = accept(fd, nullptr, nullptr);
+        if (conn.fd < 0) {
+            continue;
+        }
+        cout << "Client connected." << endl;
+        serveClient(conn);
+        close(conn.fd);
+        cout << "Client disconnected, received " << conn.bytesReceived << " bytes, sent " << conn.bytesSent << " bytes." << endl;
+    }
+    return 0;
+}
+
+// Client input is checked before it indexes the contexts or the store, and a message that fails
+// to deserialize drops the client instead of the server.
+void serveClient(PdqConn &conn) {
+    uint32_t type;
+    string payload;
+    int setupNum = 0;
+    int recordNum = 0;
+    try {
+        while (recvMsg(conn, type, payload)) {
+            if (type == MSG_SETUP) {
+                if (setupNum >= rnsModulusNumber) {
+                    cout << "More than " << rnsModulusNumber << " contexts received, client dropped." << endl;
+                    return;
+                }
+                std::stringstream s(payload);
+                const int q = setupNum++;
+                Serial::Deserialize(cc[q], s, SerType::BINARY);
+                Serial::Deserialize(publicKey[q], s, SerType::BINARY);
+                if (!cc[q] || !publicKey[q] || !cc[q] -> DeserializeEvalMultKey(s, SerType::BINARY)) {
+                    cout << "Invalid context " << q << ", client dropped." << endl;
+                    return;
+                }
+                if (setupNum == rnsModulusNumber) {
+                    cout << "Contexts and evaluation keys received." << endl;
+                }
+            } else if (type == MSG_TABLE) {
+                std::stringstream s(payload);
+                if (!(s >> tau >> columnNum) || tau < 0 || columnNum < 1) {
+                    cout << "Invalid table header, client dropped." << endl;
+                    tau = 0;
+                    ctRnsData.clear();
+                    return;
+                }
+                ctRnsData.assign(tau, vector<T_CP>());
+                recordNum = 0;
+                tableVersion++;
+            } else if (type == MSG_RECORD) {
+                if (recordNum >= tau) {
+                    cout << (ctRnsData.empty() ? "Record received before the table header, rejected." : "Record beyond the announced table size, rejected.") << endl;
+                    continue;
+                }
+                std::stringstream s(payload);
+                for (int k = 0; k < columnNum * rnsModulusNumber; k++) {
+                    ctRnsData[recordNum].push_back(readCiphertext(s));
+                    if (!ctRnsData[recordNum].back()) {
+                        cout << "Invalid record " << recordNum << ", client dropped." << endl;
+                        ctRnsData[recordNum].clear();
+                        return;
+                    }
+                }
+                tableVersion++;
+                if (conditionCache) {
+                    conditionCache -> invalidateBefore(tableVersion);
+                }
+                if (++recordNum == tau) {
+                    cout << "Encrypted table of " << tau << " records received." << endl;
+                }
+            } else if (type == MSG_QUERY) {
+                if (setupNum < rnsModulusNumber || recordNum < tau) {
+                    cout << "Query received before the contexts and the whole table, client dropped." << endl;
+                    return;
+                }
+                string response;
+                if (!evalQuery(payload, response)) {
+                    return;
+                }
+                sendMsg(conn, MSG_RESULT, response);
+            } else if (type == MSG_BYE) {
+                return;
+            }
+        }
+    } catch (const std::exception &e) {
+        cout << "Malformed message (" << e.what() << "), client dropped." << endl;
+    }
+}
+
+// Equality conditions on the first numEq columns, retrieval of the last column. The mask of a
+// condition with a predicate id is taken from the condition cache when it was already computed
+// on the current table.
+bool evalQuery(const string &payload, string &response) {
+    std::chrono::steady_clock::time_point t_io_before = std::chrono::steady_clock::now();
+    std::stringstream in(payload);
+    int numEq;
+    // the last column is the one retrieved
+    if (!(in >> numEq) || numEq < 0 || numEq > columnNum - 1) {
+        cout << "Query with an invalid number of conditions, client dropped." << endl;
+        return false;
+    }
+    vector<string> predicateId(numEq);
+    for (int j = 0; j < numEq; j++) {
+        in >> predicateId[j];
+    }
+    in.get();
+    vector<T_CP> ctQuery;
+    for (int k = 0; k < numEq * rnsModulusNumber; k++) {
+        ctQuery.push_back(readCiphertext(in));
+        if (!ctQuery.back()) {
+            cout << "Invalid query ciphertext, client dropped." << endl;
+            return false;
+        }
+    }
+    std::chrono::steady_clock::time_point t_io_after = std::chrono::steady_clock::now();
+
+    vector<int64_t> vectorOfInts1 = {1};
+    vector<T_CP> result(tau * rnsModulusNumber);
+    std::chrono::steady_clock::time_point t_query_before = std::chrono::steady_clock::now();
+    vector<vector<T_CP>> mask(numEq);   // mask[j][i * rnsModulusNumber + q]
+    for (int j = 0; j < numEq; j++) {
+        const bool cacheable = conditionCache && predicateId[j] != "-";
+        const vector<T_CP> *cached = cacheable ? conditionCache -> get(predicateId[j], tableVersion) : nullptr;
+        if (cached) {
+            mask[j] = *cached;
+            continue;
+        }
+        // rns_eq is 0 on a match, so the mask is its complement
+        mask[j].resize(tau * rnsModulusNumber);
+        for (int i = 0; i < tau; i++) {
+            for (int q = 0; q < rnsModulusNumber; q++) {
+                Plaintext ptOne = cc[q] -> MakeCoefPackedPlaintext(vectorOfInts1);
+                auto neq = rns_eq(ctRnsData[i][j * rnsModulusNumber + q], ctQuery[j * rnsModulusNumber + q], q);
+                mask[j][i * rnsModulusNumber + q] = cc[q] -> EvalSub(ptOne, neq);
+            }
+        }
+        if (cacheable) {
+            conditionCache -> put(predicateId[j], tableVersion, mask[j]);
+        }
+    }
+    for (int i = 0; i < tau; i++) {
+        for (int q = 0; q < rnsModulusNumber; q++) {
+            Plaintext ptOne = cc[q] -> MakeCoefPackedPlaintext(vectorOfInts1);
+            T_CP X = cc[q] -> Encrypt(publicKey[q], ptOne);
+            for (int j = 0; j < numEq; j++) {
+                X = cc[q] -> EvalMult(X, mask[j][i * rnsModulusNumber + q]);
+            }
+            result[i * rnsModulusNumber + q] = cc[q] -> EvalMult(ctRnsData[i][(columnNum - 1) * rnsModulusNumber + q], X);
+        }
+    }
+    std::chrono::steady_clock::time_point t_query_after = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_query = std::chrono::duration_cast<std::chrono::duration<double>>(t_query_after - t_query_before);
+    cout << "Query processing time: " << time_used_for_query.count() << endl;
+    if (conditionCache) {
+        conditionCache -> report();
+    }
+
+    std::chrono::steady_clock::time_point t_ser_before = std::chrono::steady_clock::now();
+    std::stringstream out;
+    for (auto &ct : result) {
+        writeCiphertext(out, ct);
+    }
+    string body = out.str();
+    std::chrono::steady_clock::time_point t_ser_after = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double> time_used_for_io = (t_io_after - t_io_before) + (t_ser_after - t_ser_before);
+    double times[2] = {time_used_for_query.count(), time_used_for_io.count()};
+    response = string((const char *) times, sizeof(times)) + body;
+    return true;
+}
+
+T_CP rns_eq(const T_CP &op1, const T_CP &op2, int q) {
+
+    vector<int64_t> vectorOfInts1 = {1};
+    Plaintext ptOne = cc[q] -> MakeCoefPackedPlaintext(vectorOfInts1);
+    auto res = cc[q] -> Encrypt(publicKey[q], ptOne);
+    auto ct = cc[q] -> EvalSub(op1, op2);
+    for (int x = rnsModulusVector[q] - 1; x > 0; x >>= 1)
+    {
+        if (x & 1)
+        {
+            res = cc[q]->EvalMult(ct, res);
+        }
+        ct = cc[q]->EvalMult(ct, ct);
+    }
+    return res;
+}
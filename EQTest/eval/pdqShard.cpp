@@ -0,0 +1,411 @@
+#include "openfhe.h"
+#include "pdqNet.h"
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <signal.h>
+#include <sys/wait.h>
+
+using namespace lbcrypto;
+using T_CP = Ciphertext<DCRTPoly>;
+
+using std::cout;
+using std::cin;
+using std::endl;
+using std::string;
+using std::vector;
+
+// Sharded PDQ: the coordinator partitions the encrypted table by record range across N worker
+// processes, broadcasts every query, and merges the partial results. Workers are only known by
+// their pdqNet address, so local forked workers and workers on other nodes run the same code.
+//
+// This binary plays three roles:
+//   worker <addr>              serve one shard on addr
+//   spawn <N>                  fork N local workers on Unix-domain sockets and coordinate them
+//   connect <N> <addr>...      coordinate N already running workers
+// The coordinator process also plays the data owner and querier, who hold the secret keys.
+
+CryptoContext<DCRTPoly> cc[rnsModulusNumber];
+KeyPair<DCRTPoly> keyPair[rnsModulusNumber];
+
+
+void initCcNoSIMD();
+T_CP rns_eq(const T_CP &op1, const T_CP &op2, int q, const PublicKey<DCRTPoly> &pk);
+int workerMain(const string &addr);
+bool coordinate(const vector<string> &addrs);
+void releaseWorkers(vector<PdqConn> &workers);
+
+
+int main() {
+    cout << "This program evals sharded execution of the Private Database Query protocol." << endl
+         << "Please input the role: `spawn N`, `connect N addr1 ... addrN` or `worker addr`. e.g.: spawn 4" << endl;
+    string role;
+    cin >> role;
+    if (role == "worker") {
+        string addr;
+        cin >> addr;
+        return workerMain(addr);
+    }
+
+    int n;
+    cin >> n;
+    vector<string> addrs(n);
+    vector<pid_t> children;
+    if (role == "spawn") {
+        // Fork before any OpenFHE state exists, so every worker starts with its own clean contexts
+        // and its own OpenMP thread pool.
+        for (int k = 0; k < n; k++) {
+            addrs[k] = "/tmp/pdq-shard" + std::to_string(getpid()) + "-" + std::to_string(k) + ".sock";
+            pid_t pid = fork();
+            if (pid == 0) {
+                return workerMain(addrs[k]);
+            }
+            children.push_back(pid);
+        }
+    } else if (role == "connect") {
+        for (int k = 0; k < n; k++) {
+            cin >> addrs[k];
+        }
+    } else {
+        cout << "incorrect role, please retry." << endl;
+        return 0;
+    }
+
+    // MSG_BYE to a lost worker must not kill the coordinator, and a spawned worker the
+    // coordinator never reached is still blocked in accept.
+    signal(SIGPIPE, SIG_IGN);
+    const bool ok = coordinate(addrs);
+    for (pid_t pid : children) {
+        if (!ok) {
+            kill(pid, SIGTERM);
+        }
+        waitpid(pid, nullptr, 0);
+    }
+    return ok ? 0 : 1;
+}
+
+void initCcNoSIMD() {
+    for (int i = 0; i < rnsModulusNumber; i++) {
+        const int modulus = rnsModulusVector[i];
+        CCParams<CryptoContextBFVRNS> parameters;
+        parameters.SetMultiplicativeDepth(floor(log2(modulus)) + 4);
+        parameters.SetPlaintextModulus(modulus);
+        cc[i] = GenCryptoContext(parameters);
+        cc[i]->Enable(PKE);
+        cc[i]->Enable(KEYSWITCH);
+        cc[i]->Enable(LEVELEDSHE);
+        keyPair[i] = cc[i]->KeyGen();
+        cc[i]->EvalMultKeyGen(keyPair[i].secretKey);
+    }
+    cout << "CryptoContext and KeyPair generatation is done." << endl;
+}
+
+// Worker: like pdqServer, but answers MSG_SHARD_QUERY with partial aggregates over its shard.
+// match(i) = prod_j (1 - (x_ij - y_j)^(p-1)) is 1 iff record i satisfies every condition under
+// modulus q, COUNT = sum_i match(i) and SUM = sum_i match(i) * value(i). As in pdqServer, input
+// that would index past the contexts or the shard, or fails to deserialize, ends the worker.
+int workerMain(const string &addr) {
+    int fd = pdqListen(addr);
+    if (fd < 0) {
+        return 1;
+    }
+    PdqConn conn;
+    conn.fd = accept(fd, nullptr, nullptr);
+    close(fd);
+
+    PublicKey<DCRTPoly> publicKey[rnsModulusNumber];
+    int tau = 0, columnNum = 0, setupNum = 0, recordNum = 0;
+    vector<vector<T_CP>> ctRnsData;
+
+    uint32_t type;
+    string payload;
+    try {
+        while (recvMsg(conn, type, payload)) {
+            if (type == MSG_SETUP) {
+                if (setupNum >= rnsModulusNumber) {
+                    cout << "worker " << addr << ": more than " << rnsModulusNumber << " contexts received, stopped." << endl;
+                    break;
+                }
+                std::stringstream s(payload);
+                const int q = setupNum++;
+                Serial::Deserialize(cc[q], s, SerType::BINARY);
+                Serial::Deserialize(publicKey[q], s, SerType::BINARY);
+                if (!cc[q] || !publicKey[q] || !cc[q] -> DeserializeEvalMultKey(s, SerType::BINARY)) {
+                    cout << "worker " << addr << ": invalid context " << q << ", stopped." << endl;
+                    break;
+                }
+            } else if (type == MSG_TABLE) {
+                std::stringstream s(payload);
+                if (!(s >> tau >> columnNum) || tau < 0 || columnNum < 1) {
+                    cout << "worker " << addr << ": invalid table header, stopped." << endl;
+                    break;
+                }
+                ctRnsData.assign(tau, vector<T_CP>());
+                recordNum = 0;
+            } else if (type == MSG_RECORD) {
+                if (recordNum >= tau) {
+                    cout << "worker " << addr << ": record beyond the shard size, stopped." << endl;
+                    break;
+                }
+                std::stringstream s(payload);
+                for (int k = 0; k < columnNum * rnsModulusNumber; k++) {
+                    ctRnsData[recordNum].push_back(readCiphertext(s));
+                }
+                if (std::find(ctRnsData[recordNum].begin(), ctRnsData[recordNum].end(), nullptr) != ctRnsData[recordNum].end()) {
+                    cout << "worker " << addr << ": invalid record " << recordNum << ", stopped." << endl;
+                    break;
+                }
+                recordNum++;
+            } else if (type == MSG_SHARD_QUERY) {
+                std::chrono::steady_clock::time_point t_io_before = std::chrono::steady_clock::now();
+                std::stringstream in(payload);
+                int numEq;
+                // the last column is the one aggregated
+                if (setupNum < rnsModulusNumber || recordNum < tau || !(in >> numEq) || numEq < 0 || numEq > columnNum - 1) {
+                    cout << "worker " << addr << ": invalid query, stopped." << endl;
+                    break;
+                }
+                in.get();
+                vector<T_CP> ctQuery;
+                for (int k = 0; k < numEq * rnsModulusNumber; k++) {
+                    ctQuery.push_back(readCiphertext(in));
+                }
+                if (std::find(ctQuery.begin(), ctQuery.end(), nullptr) != ctQuery.end()) {
+                    cout << "worker " << addr << ": invalid query ciphertext, stopped." << endl;
+                    break;
+                }
+                std::chrono::steady_clock::time_point t_io_after = std::chrono::steady_clock::now();
+
+                vector<int64_t> vectorOfInts1 = {1};
+                vector<int64_t> vectorOfInts0 = {0};
+                vector<T_CP> count(rnsModulusNumber), sum(rnsModulusNumber), result(tau * rnsModulusNumber);
+                for (int q = 0; q < rnsModulusNumber; q++) {
+                    Plaintext ptOne = cc[q] -> MakeCoefPackedPlaintext(vectorOfInts1);
+                    Plaintext ptZero = cc[q] -> MakeCoefPackedPlaintext(vectorOfInts0);
+                    count[q] = cc[q] -> Encrypt(publicKey[q], ptZero);
+                    sum[q] = cc[q] -> Encrypt(publicKey[q], ptZero);
+                    for (int i = 0; i < tau; i++) {
+                        T_CP match = cc[q] -> Encrypt(publicKey[q], ptOne);
+                        for (int j = 0; j < numEq; j++) {
+                            auto neq = rns_eq(ctRnsData[i][j * rnsModulusNumber + q], ctQuery[j * rnsModulusNumber + q], q, publicKey[q]);
+                            match = cc[q] -> EvalMult(match, cc[q] -> EvalSub(ptOne, neq));
+                        }
+                        result[i * rnsModulusNumber + q] = cc[q] -> EvalMult(ctRnsData[i][(columnNum - 1) * rnsModulusNumber + q], match);
+                        count[q] = cc[q] -> EvalAdd(count[q], match);
+                        sum[q] = cc[q] -> EvalAdd(sum[q], result[i * rnsModulusNumber + q]);
+                    }
+                }
+                std::chrono::steady_clock::time_point t_query_after = std::chrono::steady_clock::now();
+
+                std::stringstream out;
+                for (int q = 0; q < rnsModulusNumber; q++) {
+                    writeCiphertext(out, count[q]);
+                }
+                for (int q = 0; q < rnsModulusNumber; q++) {
+                    writeCiphertext(out, sum[q]);
+                }
+                for (auto &ct : result) {
+                    writeCiphertext(out, ct);
+                }
+                string body = out.str();
+                std::chrono::steady_clock::time_point t_ser_after = std::chrono::steady_clock::now();
+
+                std::chrono::duration<double> time_used_for_query = t_query_after - t_io_after;
+                std::chrono::duration<double> time_used_for_io = (t_io_after - t_io_before) + (t_ser_after - t_query_after);
+                double times[2] = {time_used_for_query.count(), time_used_for_io.count()};
+                sendMsg(conn, MSG_PARTIAL, string((const char *) times, sizeof(times)) + body);
+            } else if (type == MSG_BYE) {
+                break;
+            }
+        }
+    } catch (const std::exception &e) {
+        cout << "worker " << addr << ": malformed message (" << e.what() << "), stopped." << endl;
+    }
+    close(conn.fd);
+    if (addr.find(':') == string::npos) {
+        unlink(addr.c_str());
+    }
+    return 0;
+}
+
+// Returns false when a worker could not be reached or was lost.
+bool coordinate(const vector<string> &addrs) {
+    const int n = addrs.size();
+    cout << "Please input record number and number of equality query conditions. e.g.: 64 2" << endl;
+    int tau, numEq;
+    cin >> tau >> numEq;
+    const int columnNum = numEq + 1;
+
+    vector<PdqConn> workers(n);
+    for (int k = 0; k < n; k++) {
+        // local workers may still be starting up
+        for (int retry = 0; retry < 50 && workers[k].fd < 0; retry++) {
+            workers[k].fd = pdqConnect(addrs[k]);
+            if (workers[k].fd < 0) {
+                usleep(100000);
+            }
+        }
+        if (workers[k].fd < 0) {
+            cout << "cannot reach worker " << addrs[k] << endl;
+            releaseWorkers(workers);
+            return false;
+        }
+    }
+
+    initCcNoSIMD();
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        std::stringstream s;
+        Serial::Serialize(cc[q], s, SerType::BINARY);
+        Serial::Serialize(keyPair[q].publicKey, s, SerType::BINARY);
+        cc[q] -> SerializeEvalMultKey(s, SerType::BINARY, keyPair[q].secretKey -> GetKeyTag());
+        for (int k = 0; k < n; k++) {
+            sendMsg(workers[k], MSG_SETUP, s.str());
+        }
+    }
+
+    // Scatter the table: worker k gets records [shardBegin[k], shardBegin[k + 1]).
+    vector<int> shardBegin(n + 1);
+    for (int k = 0; k <= n; k++) {
+        shardBegin[k] = (int64_t) tau * k / n;
+    }
+    vector<vector<int64_t>> ptRnsData(tau, vector<int64_t>(columnNum * rnsModulusNumber));
+    {
+        std::default_random_engine dre;
+        dre.seed(time(0));
+        std::uniform_int_distribution<int64_t> u = std::uniform_int_distribution<int64_t>(0, plaintextModulus);
+        vector<int64_t> tmp(1);
+        for (int k = 0; k < n; k++) {
+            sendMsg(workers[k], MSG_TABLE, std::to_string(shardBegin[k + 1] - shardBegin[k]) + " " + std::to_string(columnNum));
+            for (int i = shardBegin[k]; i < shardBegin[k + 1]; i++) {
+                std::stringstream s;
+                for (int j = 0; j < columnNum; j++) {
+                    int64_t num = u(dre);
+                    for (int q = 0; q < rnsModulusNumber; q++) {
+                        int64_t rns_val = (num % (rnsModulusVector[q])) - rnsModulusVector[q] / 2;
+                        ptRnsData[i][j * rnsModulusNumber + q] = rns_val;
+                        tmp[0] = rns_val;
+                        Plaintext pt = cc[q] -> MakeCoefPackedPlaintext(tmp);
+                        writeCiphertext(s, cc[q] -> Encrypt(keyPair[q].publicKey, pt));
+                    }
+                }
+                sendMsg(workers[k], MSG_RECORD, s.str());
+            }
+        }
+        cout << "Data generation and encryption is done, " << tau << " records over " << n << " workers." << endl;
+    }
+
+    // Query: the condition of record 0, broadcast to every worker before any result is awaited.
+    std::stringstream s;
+    s << numEq << "\n";
+    vector<int64_t> tmp(1);
+    for (int j = 0; j < numEq; j++) {
+        for (int q = 0; q < rnsModulusNumber; q++) {
+            tmp[0] = ptRnsData[0][j * rnsModulusNumber + q];
+            Plaintext pt = cc[q] -> MakeCoefPackedPlaintext(tmp);
+            writeCiphertext(s, cc[q] -> Encrypt(keyPair[q].publicKey, pt));
+        }
+    }
+    const string query = s.str();
+
+    std::chrono::steady_clock::time_point t_query_before = std::chrono::steady_clock::now();
+    for (int k = 0; k < n; k++) {
+        sendMsg(workers[k], MSG_SHARD_QUERY, query);
+    }
+
+    // Gather: partial COUNT/SUM are added homomorphically, per-record results are concatenated.
+    vector<T_CP> count(rnsModulusNumber), sum(rnsModulusNumber), result(tau * rnsModulusNumber);
+    double maxEvalTime = 0.0, mergeTime = 0.0;
+    for (int k = 0; k < n; k++) {
+        uint32_t type;
+        string payload;
+        if (!recvMsg(workers[k], type, payload) || type != MSG_PARTIAL) {
+            cout << "lost worker " << addrs[k] << endl;
+            releaseWorkers(workers);
+            return false;
+        }
+        std::chrono::steady_clock::time_point t_merge_before = std::chrono::steady_clock::now();
+        double times[2];
+        memcpy(times, payload.data(), sizeof(times));
+        maxEvalTime = std::max(maxEvalTime, times[0]);
+        cout << "worker " << k << ": " << shardBegin[k + 1] - shardBegin[k] << " records, evaluate " << times[0] << endl;
+
+        std::stringstream in(payload.substr(sizeof(times)));
+        for (int q = 0; q < rnsModulusNumber; q++) {
+            T_CP partial = readCiphertext(in);
+            count[q] = count[q] ? cc[q] -> EvalAdd(count[q], partial) : partial;
+        }
+        for (int q = 0; q < rnsModulusNumber; q++) {
+            T_CP partial = readCiphertext(in);
+            sum[q] = sum[q] ? cc[q] -> EvalAdd(sum[q], partial) : partial;
+        }
+        for (int i = shardBegin[k]; i < shardBegin[k + 1]; i++) {
+            for (int q = 0; q < rnsModulusNumber; q++) {
+                result[i * rnsModulusNumber + q] = readCiphertext(in);
+            }
+        }
+        std::chrono::duration<double> time_used_for_merge = std::chrono::steady_clock::now() - t_merge_before;
+        mergeTime += time_used_for_merge.count();
+    }
+    std::chrono::steady_clock::time_point t_query_after = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_query = std::chrono::duration_cast<std::chrono::duration<double>>(t_query_after - t_query_before);
+    cout << "Query processing time: " << time_used_for_query.count() << ", slowest worker: " << maxEvalTime
+         << ", merge: " << mergeTime << ", scatter/gather: " << time_used_for_query.count() - maxEvalTime - mergeTime << endl;
+
+    // Check the merged aggregates against the plaintext, modulus by modulus.
+    bool correct = true;
+    for (int q = 0; q < rnsModulusNumber; q++) {
+        const int64_t p = rnsModulusVector[q];
+        int64_t expectedCount = 0, expectedSum = 0;
+        for (int i = 0; i < tau; i++) {
+            bool match = true;
+            for (int j = 0; j < numEq; j++) {
+                match = match && ptRnsData[i][j * rnsModulusNumber + q] == ptRnsData[0][j * rnsModulusNumber + q];
+            }
+            if (match) {
+                expectedCount++;
+                expectedSum += ptRnsData[i][(columnNum - 1) * rnsModulusNumber + q];
+            }
+        }
+        Plaintext ptCount, ptSum;
+        cc[q] -> Decrypt(keyPair[q].secretKey, count[q], &ptCount);
+        cc[q] -> Decrypt(keyPair[q].secretKey, sum[q], &ptSum);
+        correct = correct && ((ptCount -> GetCoefPackedValue()[0] - expectedCount) % p + p) % p == 0
+                          && ((ptSum -> GetCoefPackedValue()[0] - expectedSum) % p + p) % p == 0;
+    }
+    cout << "Merged COUNT/SUM check: " << (correct ? "correct" : "mismatch") << endl;
+
+    releaseWorkers(workers);
+    return true;
+}
+
+// Sends MSG_BYE to every connected worker and closes its socket.
+void releaseWorkers(vector<PdqConn> &workers) {
+    for (auto &worker : workers) {
+        if (worker.fd >= 0) {
+            sendMsg(worker, MSG_BYE, "");
+            close(worker.fd);
+            worker.fd = -1;
+        }
+    }
+}
+
+// (op1 - op2)^(p-1): 0 if op1 equals op2, 1 otherwise.
+T_CP rns_eq(const T_CP &op1, const T_CP &op2, int q, const PublicKey<DCRTPoly> &pk) {
+
+    vector<int64_t> vectorOfInts1 = {1};
+    Plaintext ptOne = cc[q] -> MakeCoefPackedPlaintext(vectorOfInts1);
+    auto res = cc[q] -> Encrypt(pk, ptOne);
+    auto ct = cc[q] -> EvalSub(op1, op2);
+    for (int x = rnsModulusVector[q] - 1; x > 0; x >>= 1)
+    {
+        if (x & 1)
+        {
+            res = cc[q]->EvalMult(ct, res);
+        }
+        ct = cc[q]->EvalMult(ct, ct);
+    }
+    return res;
+}
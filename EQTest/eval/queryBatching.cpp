@@ -0,0 +1,347 @@
+#include "openfhe.h"
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+
+using namespace lbcrypto;
+using T_CP = Ciphertext<DCRTPoly>;
+
+using std::cout;
+using std::cin;
+using std::endl;
+using std::string;
+using std::vector;
+
+// SIMD packing needs p = 1 mod 2n, so batching uses the NTT-friendly CRT moduli of crtEQTestSIMD.
+// Two values below 2^32 are equal iff they are equal under both moduli.
+const int crtModulusNumber = 2;
+const vector<int64_t> crtModulusVector = {65537, 786433};
+CryptoContext<DCRTPoly> cc[crtModulusNumber];
+KeyPair<DCRTPoly> keyPair[crtModulusNumber];
+int slots;
+
+// Slot layout: the slots are split into `laneNum` lanes of `laneSize` slots. Every record block
+// holds records [b * laneSize, (b + 1) * laneSize) replicated in every lane, so query k can be
+// compared against the whole block in lane k while the other lanes serve other queries.
+int laneNum;
+int laneSize;
+vector<vector<T_CP>> ctBlock;          // ctBlock[b][q]
+vector<vector<T_CP>> ctDense;          // ctDense[b][q], the same records once per slot, for the baseline
+vector<vector<Plaintext>> laneMask;    // laneMask[k][q], 1 in the slots of lane k
+
+// A query as submitted by an analyst: its value replicated in every slot, per modulus.
+struct QueryRequest {
+    T_CP ct[crtModulusNumber];
+    std::promise<vector<vector<T_CP>>> result;    // result[b][q], only lane `lane` is meaningful
+    int lane;
+    std::chrono::steady_clock::time_point enqueued;    // start of the batching window of this query
+};
+
+std::mutex queueMutex;
+std::condition_variable queueCv;
+vector<QueryRequest *> queryQueue;
+bool serverStop = false;
+
+
+bool initCcSIMD();
+int64_t centered(int64_t val, int64_t modulus);
+vector<vector<T_CP>> buildBlocks(const vector<int64_t> &records, int lanes, int size);
+T_CP encryptQuery(int64_t val, int q);
+T_CP eqChain(const T_CP &op1, const T_CP &op2, int q);
+vector<vector<T_CP>> evalPacked(const vector<vector<T_CP>> &store, const T_CP query[crtModulusNumber]);
+void batchServer(int windowMs);
+int countMatches(const vector<vector<T_CP>> &result, int lane, int tau);
+
+
+bool initCcSIMD() {
+    for (int i = 0; i < crtModulusNumber; i++) {
+        const int64_t modulus = crtModulusVector[i];
+        CCParams<CryptoContextBFVRNS> parameters;
+        // the chain, plus one level for the lane mask and one for demultiplexing
+        parameters.SetMultiplicativeDepth(ceil(log2(modulus)) + 2);
+        parameters.SetPlaintextModulus(modulus);
+        cc[i] = GenCryptoContext(parameters);
+        cc[i]->Enable(PKE);
+        cc[i]->Enable(KEYSWITCH);
+        cc[i]->Enable(LEVELEDSHE);
+        keyPair[i] = cc[i]->KeyGen();
+        cc[i]->EvalMultKeyGen(keyPair[i].secretKey);
+    }
+    // every context must give the same slot count, the packed layout is shared by all moduli
+    slots = cc[0]->GetRingDimension();
+    for (int i = 1; i < crtModulusNumber; i++) {
+        if ((int) cc[i]->GetRingDimension() != slots) {
+            cout << "Ring dimension " << cc[i]->GetRingDimension() << " of modulus " << i << " differs from " << slots
+                 << " of modulus 0, the packed layout needs one slot count." << endl;
+            return false;
+        }
+    }
+    cout << "CryptoContext and KeyPair generatation is done, " << slots << " slots per ciphertext." << endl;
+    return true;
+}
+
+int main() {
+    cout << "This program evals cross-client batching of equality queries into shared SIMD slots." << endl
+         << "Please input record number, lane number (queries per batch), analyst number, queries per analyst and the batching window in ms. e.g.: 1024 16 16 2 50" << endl;
+    int tau, analystNum, queryPerAnalyst, windowMs;
+    cin >> tau >> laneNum >> analystNum >> queryPerAnalyst >> windowMs;
+
+    if (!initCcSIMD()) {
+        return 0;
+    }
+    if (tau <= 0 || laneNum <= 0 || slots % laneNum != 0) {
+        cout << "lane number must divide " << slots << ", please retry." << endl;
+        return 0;
+    }
+    laneSize = slots / laneNum;
+
+    std::default_random_engine dre;
+    dre.seed(time(0));
+    std::uniform_int_distribution<int64_t> u = std::uniform_int_distribution<int64_t>(0, UINT32_MAX);
+    vector<int64_t> records(tau);
+    for (int i = 0; i < tau; i++) {
+        records[i] = u(dre);
+    }
+    ctBlock = buildBlocks(records, laneNum, laneSize);
+    ctDense = buildBlocks(records, 1, slots);
+    cout << "Data generation and encryption is done, " << ctBlock.size() << " block(s) of " << laneSize << " records, "
+         << ctDense.size() << " block(s) of " << slots << " records without lanes." << endl;
+
+    // A full batch costs ctBlock.size() chains per modulus, the same queries unbatched cost
+    // laneNum * ctDense.size(). Once tau reaches the slot count the records are replicated into
+    // laneNum times as many blocks and the two are equal, so batching only pays for tau < slots.
+    const double effectiveLanes = (double) laneNum * ctDense.size() / ctBlock.size();
+    cout << "Effective lanes: " << effectiveLanes << " of " << laneNum << " (EQ chains per batch: " << ctBlock.size()
+         << ", per unbatched query: " << ctDense.size() << ")" << endl;
+    if (ctBlock.size() >= laneNum * ctDense.size()) {
+        cout << "No gain expected: " << tau << " records fill the " << slots
+             << " slots, so the lane layout evaluates as many chains as unbatched queries." << endl;
+    }
+
+    laneMask.assign(laneNum, vector<Plaintext>(crtModulusNumber));
+    for (int k = 0; k < laneNum; k++) {
+        vector<int64_t> mask(slots, 0);
+        for (int r = 0; r < laneSize; r++) {
+            mask[k * laneSize + r] = 1;
+        }
+        for (int q = 0; q < crtModulusNumber; q++) {
+            laneMask[k][q] = cc[q] -> MakePackedPlaintext(mask);
+        }
+    }
+
+    // Baseline: one full pass per query over the records packed once per slot, which is what an
+    // unbatched server would store. The pass over the lane-replicated blocks is reported as well,
+    // it touches laneNum times more ciphertexts for the same records.
+    const int totalQuery = analystNum * queryPerAnalyst;
+    double sequentialTime, replicatedTime;
+    {
+        const int sampleNum = std::min(totalQuery, 2);
+        double time_used[2];
+        const vector<vector<T_CP>> *store[2] = {&ctDense, &ctBlock};
+        for (int l = 0; l < 2; l++) {
+            std::chrono::steady_clock::time_point t_before = std::chrono::steady_clock::now();
+            for (int k = 0; k < sampleNum; k++) {
+                T_CP query[crtModulusNumber];
+                for (int q = 0; q < crtModulusNumber; q++) {
+                    query[q] = encryptQuery(records[k % tau], q);
+                }
+                evalPacked(*store[l], query);
+            }
+            std::chrono::steady_clock::time_point t_after = std::chrono::steady_clock::now();
+            time_used[l] = std::chrono::duration_cast<std::chrono::duration<double>>(t_after - t_before).count() / std::max(sampleNum, 1);
+        }
+        sequentialTime = time_used[0];
+        replicatedTime = time_used[1];
+        cout << "Unbatched time per query: " << sequentialTime << ", throughput: " << 1.0 / sequentialTime << " queries/s" << endl
+             << "Unbatched time per query on the lane layout: " << replicatedTime << ", throughput: " << 1.0 / replicatedTime << " queries/s" << endl;
+    }
+
+    // Batched: every analyst submits its queries concurrently, the server evaluates a batch once
+    // it has `laneNum` queries or the window of the oldest pending query expires.
+    std::thread server(batchServer, windowMs);
+    vector<std::thread> analysts;
+    std::mutex statMutex;
+    double latencySum = 0.0;
+    int correct = 0;
+    std::chrono::steady_clock::time_point t_batch_before = std::chrono::steady_clock::now();
+    for (int a = 0; a < analystNum; a++) {
+        analysts.emplace_back([&, a]() {
+            for (int k = 0; k < queryPerAnalyst; k++) {
+                const int row = (a * queryPerAnalyst + k) % tau;
+                QueryRequest req;
+                std::chrono::steady_clock::time_point t_before = std::chrono::steady_clock::now();
+                for (int q = 0; q < crtModulusNumber; q++) {
+                    req.ct[q] = encryptQuery(records[row], q);
+                }
+                std::future<vector<vector<T_CP>>> fut = req.result.get_future();
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex);
+                    req.enqueued = std::chrono::steady_clock::now();
+                    queryQueue.push_back(&req);
+                }
+                queueCv.notify_all();
+                vector<vector<T_CP>> result = fut.get();
+                std::chrono::steady_clock::time_point t_after = std::chrono::steady_clock::now();
+
+                int expected = 0;
+                for (int i = 0; i < tau; i++) {
+                    expected += records[i] == records[row];
+                }
+                bool ok = countMatches(result, req.lane, tau) == expected;
+                std::chrono::duration<double> time_used = t_after - t_before;
+                std::lock_guard<std::mutex> lock(statMutex);
+                latencySum += time_used.count();
+                correct += ok;
+            }
+        });
+    }
+    for (auto &t : analysts) {
+        t.join();
+    }
+    std::chrono::steady_clock::time_point t_batch_after = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        serverStop = true;
+    }
+    queueCv.notify_all();
+    server.join();
+
+    std::chrono::duration<double> time_used_for_batch = std::chrono::duration_cast<std::chrono::duration<double>>(t_batch_after - t_batch_before);
+    cout << "Batched total time: " << time_used_for_batch.count() << " for " << totalQuery << " queries" << endl
+         << "Batched throughput: " << totalQuery / time_used_for_batch.count() << " queries/s, "
+         << "speedup: " << sequentialTime * totalQuery / time_used_for_batch.count() << "x, "
+         << "against the lane layout: " << replicatedTime * totalQuery / time_used_for_batch.count() << "x" << endl
+         << "Average latency: " << latencySum / std::max(totalQuery, 1) << endl
+         << "Correct results: " << correct << "/" << totalQuery << endl;
+    return 0;
+}
+
+int64_t centered(int64_t val, int64_t modulus) {
+    val %= modulus;
+    if (val < 0) {
+        val += modulus;
+    }
+    return val > modulus / 2 ? val - modulus : val;
+}
+
+// Blocks of `size` records, each replicated in `lanes` lanes of `size` slots.
+vector<vector<T_CP>> buildBlocks(const vector<int64_t> &records, int lanes, int size) {
+    const int tau = records.size();
+    const int blockNum = (tau + size - 1) / size;
+    vector<vector<T_CP>> blocks(blockNum, vector<T_CP>(crtModulusNumber));
+    for (int b = 0; b < blockNum; b++) {
+        for (int q = 0; q < crtModulusNumber; q++) {
+            vector<int64_t> v(slots, 0);
+            for (int k = 0; k < lanes; k++) {
+                for (int r = 0; r < size && b * size + r < tau; r++) {
+                    v[k * size + r] = centered(records[b * size + r], crtModulusVector[q]);
+                }
+            }
+            Plaintext pt = cc[q] -> MakePackedPlaintext(v);
+            blocks[b][q] = cc[q] -> Encrypt(keyPair[q].publicKey, pt);
+        }
+    }
+    return blocks;
+}
+
+// The analyst does not know its lane in advance, so it replicates the query into every slot and
+// the server keeps only the lane it assigns.
+T_CP encryptQuery(int64_t val, int q) {
+    vector<int64_t> v(slots, centered(val, crtModulusVector[q]));
+    Plaintext pt = cc[q] -> MakePackedPlaintext(v);
+    return cc[q] -> Encrypt(keyPair[q].publicKey, pt);
+}
+
+// 1 - (op1 - op2)^(p-1), i.e. 1 in the slots where op1 equals op2 and 0 elsewhere.
+T_CP eqChain(const T_CP &op1, const T_CP &op2, int q) {
+    auto ct = cc[q] -> EvalSub(op1, op2);
+    T_CP res;
+    for (int64_t x = crtModulusVector[q] - 1; x > 0; x >>= 1)
+    {
+        if (x & 1)
+        {
+            res = res ? cc[q]->EvalMult(ct, res) : ct;
+        }
+        if (x > 1) {
+            ct = cc[q]->EvalMult(ct, ct);
+        }
+    }
+    vector<int64_t> ones(slots, 1);
+    return cc[q] -> EvalSub(cc[q] -> MakePackedPlaintext(ones), res);
+}
+
+vector<vector<T_CP>> evalPacked(const vector<vector<T_CP>> &store, const T_CP query[crtModulusNumber]) {
+    vector<vector<T_CP>> result(store.size(), vector<T_CP>(crtModulusNumber));
+    for (size_t b = 0; b < store.size(); b++) {
+        for (int q = 0; q < crtModulusNumber; q++) {
+            result[b][q] = eqChain(store[b][q], query[q], q);
+        }
+    }
+    return result;
+}
+
+void batchServer(int windowMs) {
+    while (true) {
+        vector<QueryRequest *> batch;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCv.wait(lock, []() { return serverStop || !queryQueue.empty(); });
+            if (queryQueue.empty()) {
+                return;
+            }
+            // the window runs from the oldest pending query, not from when the server woke up
+            queueCv.wait_until(lock, queryQueue.front() -> enqueued + std::chrono::milliseconds(windowMs),
+                               []() { return serverStop || (int) queryQueue.size() >= laneNum; });
+            const int n = std::min((int) queryQueue.size(), laneNum);
+            batch.assign(queryQueue.begin(), queryQueue.begin() + n);
+            queryQueue.erase(queryQueue.begin(), queryQueue.begin() + n);
+        }
+
+        // Pack: query k keeps only lane k.
+        T_CP packed[crtModulusNumber];
+        for (int q = 0; q < crtModulusNumber; q++) {
+            for (size_t k = 0; k < batch.size(); k++) {
+                auto masked = cc[q] -> EvalMult(batch[k] -> ct[q], laneMask[k][q]);
+                packed[q] = packed[q] ? cc[q] -> EvalAdd(packed[q], masked) : masked;
+            }
+        }
+
+        vector<vector<T_CP>> result = evalPacked(ctBlock, packed);
+
+        // Demultiplex: every analyst only receives its own lane.
+        for (size_t k = 0; k < batch.size(); k++) {
+            vector<vector<T_CP>> own(result.size(), vector<T_CP>(crtModulusNumber));
+            for (size_t b = 0; b < result.size(); b++) {
+                for (int q = 0; q < crtModulusNumber; q++) {
+                    own[b][q] = cc[q] -> EvalMult(result[b][q], laneMask[k][q]);
+                }
+            }
+            batch[k] -> lane = k;
+            batch[k] -> result.set_value(own);
+        }
+    }
+}
+
+// Client side: a record matches iff its slot decrypts to 1 under every modulus.
+int countMatches(const vector<vector<T_CP>> &result, int lane, int tau) {
+    int matches = 0;
+    for (size_t b = 0; b < result.size(); b++) {
+        vector<Plaintext> pt(crtModulusNumber);
+        for (int q = 0; q < crtModulusNumber; q++) {
+            cc[q] -> Decrypt(keyPair[q].secretKey, result[b][q], &pt[q]);
+        }
+        for (int r = 0; r < laneSize && (int) b * laneSize + r < tau; r++) {
+            bool match = true;
+            for (int q = 0; q < crtModulusNumber; q++) {
+                match = match && pt[q] -> GetPackedValue()[lane * laneSize + r] == 1;
+            }
+            matches += match;
+        }
+    }
+    return matches;
+}
@@ -0,0 +1,240 @@
+#include "openfhe.h"
+
+// header files needed for serialization
+#include "ciphertext-ser.h"
+#include "cryptocontext-ser.h"
+#include "key/key-ser.h"
+#include "scheme/bfvrns/bfvrns-ser.h"
+
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+
+using namespace lbcrypto;
+using T_CP = Ciphertext<DCRTPoly>;
+
+using std::cout;
+using std::cin;
+using std::endl;
+using std::string;
+using std::vector;
+
+// SIMD packing needs p = 1 mod 2n, so the packed store uses the NTT-friendly CRT moduli of crtEQTestSIMD.
+const int crtModulusNumber = 2;
+const vector<int64_t> crtModulusVector = {65537, 786433};
+CryptoContext<DCRTPoly> cc[crtModulusNumber];
+KeyPair<DCRTPoly> keyPair[crtModulusNumber];
+int slots;
+
+// A packed conjunctive query compares every condition value against a whole column, so each
+// value has to sit in every slot. Replicated upload: the client sends one ciphertext per condition
+// and modulus, each holding the value in all slots. Compact upload: the client sends one
+// ciphertext per modulus with condition j in slot j, and the server replicates each value by
+// masking its slot and summing over all slots, which EvalSum does in log2(slots) rotations and
+// additions with the precomputed EvalSum rotation keys.
+
+
+bool initCcSIMD(int numEq);
+int64_t centered(int64_t val, int64_t modulus);
+size_t serializedSize(const T_CP &ct);
+T_CP replicate(const T_CP &compact, int j, int q);
+T_CP eqChain(const T_CP &op1, const T_CP &op2, int q);
+
+
+bool initCcSIMD(int numEq) {
+    for (int i = 0; i < crtModulusNumber; i++) {
+        const int64_t modulus = crtModulusVector[i];
+        CCParams<CryptoContextBFVRNS> parameters;
+        // the chain, the AND of the conditions and one level for the slot mask
+        parameters.SetMultiplicativeDepth(ceil(log2(modulus)) + ceil(log2(numEq)) + 1);
+        parameters.SetPlaintextModulus(modulus);
+        cc[i] = GenCryptoContext(parameters);
+        cc[i]->Enable(PKE);
+        cc[i]->Enable(KEYSWITCH);
+        cc[i]->Enable(LEVELEDSHE);
+        cc[i]->Enable(ADVANCEDSHE);
+        keyPair[i] = cc[i]->KeyGen();
+        cc[i]->EvalMultKeyGen(keyPair[i].secretKey);
+        cc[i]->EvalSumKeyGen(keyPair[i].secretKey);
+    }
+    // every context must give the same slot count, the packed layout is shared by all moduli
+    slots = cc[0]->GetRingDimension();
+    for (int i = 1; i < crtModulusNumber; i++) {
+        if ((int) cc[i]->GetRingDimension() != slots) {
+            cout << "Ring dimension " << cc[i]->GetRingDimension() << " of modulus " << i << " differs from " << slots
+                 << " of modulus 0, the packed layout needs one slot count." << endl;
+            return false;
+        }
+    }
+    cout << "CryptoContext and KeyPair generatation is done, " << slots << " slots per ciphertext." << endl;
+    return true;
+}
+
+int main() {
+    cout << "This program evals server-side replication of a compact query across SIMD slots." << endl
+         << "Please input record number (at most one ciphertext of slots) and number of equality query conditions. e.g.: 32768 2" << endl;
+    int tau, numEq;
+    cin >> tau >> numEq;
+
+    if (!initCcSIMD(numEq)) {
+        return 0;
+    }
+    if (tau <= 0 || tau > slots || numEq <= 0 || numEq > slots) {
+        cout << "incorrect parameter, please retry." << endl;
+        return 0;
+    }
+
+    // Packed columns, every odd record is a copy of record 0 so that the query has matches.
+    std::default_random_engine dre;
+    dre.seed(time(0));
+    std::uniform_int_distribution<int64_t> u = std::uniform_int_distribution<int64_t>(0, UINT32_MAX);
+    vector<vector<int64_t>> column(numEq, vector<int64_t>(tau));
+    for (int j = 0; j < numEq; j++) {
+        for (int i = 0; i < tau; i++) {
+            column[j][i] = (i & 1) ? column[j][0] : u(dre);
+        }
+    }
+    T_CP ctColumn[numEq][crtModulusNumber];
+    for (int j = 0; j < numEq; j++) {
+        for (int q = 0; q < crtModulusNumber; q++) {
+            vector<int64_t> v(slots, 0);
+            for (int i = 0; i < tau; i++) {
+                v[i] = centered(column[j][i], crtModulusVector[q]);
+            }
+            Plaintext pt = cc[q] -> MakePackedPlaintext(v);
+            ctColumn[j][q] = cc[q] -> Encrypt(keyPair[q].publicKey, pt);
+        }
+    }
+    cout << "Data generation and encryption is done." << endl;
+
+    // Client: the query is the condition of record 0, in both upload forms.
+    size_t replicatedBytes = 0, compactBytes = 0;
+    T_CP ctCompact[crtModulusNumber];
+    for (int q = 0; q < crtModulusNumber; q++) {
+        for (int j = 0; j < numEq; j++) {
+            vector<int64_t> v(slots, centered(column[j][0], crtModulusVector[q]));
+            Plaintext pt = cc[q] -> MakePackedPlaintext(v);
+            replicatedBytes += serializedSize(cc[q] -> Encrypt(keyPair[q].publicKey, pt));
+        }
+        vector<int64_t> v(numEq);
+        for (int j = 0; j < numEq; j++) {
+            v[j] = centered(column[j][0], crtModulusVector[q]);
+        }
+        Plaintext pt = cc[q] -> MakePackedPlaintext(v);
+        ctCompact[q] = cc[q] -> Encrypt(keyPair[q].publicKey, pt);
+        compactBytes += serializedSize(ctCompact[q]);
+    }
+    cout << "Query upload: replicated " << replicatedBytes << " bytes, compact " << compactBytes << " bytes, saved "
+         << replicatedBytes - compactBytes << " bytes (" << 100.0 * (replicatedBytes - compactBytes) / replicatedBytes << "%)" << endl;
+
+    // Server: replicate every condition value across the slots.
+    T_CP ctQuery[numEq][crtModulusNumber];
+    std::chrono::steady_clock::time_point t_rep_before = std::chrono::steady_clock::now();
+    for (int j = 0; j < numEq; j++) {
+        for (int q = 0; q < crtModulusNumber; q++) {
+            ctQuery[j][q] = replicate(ctCompact[q], j, q);
+        }
+    }
+    std::chrono::steady_clock::time_point t_rep_after = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_rep = std::chrono::duration_cast<std::chrono::duration<double>>(t_rep_after - t_rep_before);
+    cout << "Server replication time: " << time_used_for_rep.count() << ", per condition and modulus: "
+         << time_used_for_rep.count() / (numEq * crtModulusNumber) << endl;
+
+    bool replicated = true;
+    for (int j = 0; j < numEq; j++) {
+        for (int q = 0; q < crtModulusNumber; q++) {
+            Plaintext pt;
+            cc[q] -> Decrypt(keyPair[q].secretKey, ctQuery[j][q], &pt);
+            for (int64_t val : pt -> GetPackedValue()) {
+                replicated = replicated && val == centered(column[j][0], crtModulusVector[q]);
+            }
+        }
+    }
+    cout << "Replication check: " << (replicated ? "correct" : "mismatch") << endl;
+
+    // The packed query itself: AND of the conditions over all records at once, as a balanced
+    // product tree so it costs ceil(log2(numEq)) levels.
+    std::chrono::steady_clock::time_point t_query_before = std::chrono::steady_clock::now();
+    T_CP X[crtModulusNumber];
+    for (int q = 0; q < crtModulusNumber; q++) {
+        vector<T_CP> eq;
+        for (int j = 0; j < numEq; j++) {
+            eq.push_back(eqChain(ctColumn[j][q], ctQuery[j][q], q));
+        }
+        while (eq.size() > 1) {
+            vector<T_CP> next;
+            for (size_t k = 0; k + 1 < eq.size(); k += 2) {
+                next.push_back(cc[q] -> EvalMult(eq[k], eq[k + 1]));
+            }
+            if (eq.size() & 1) {
+                next.push_back(eq.back());
+            }
+            eq = next;
+        }
+        X[q] = eq[0];
+    }
+    std::chrono::steady_clock::time_point t_query_after = std::chrono::steady_clock::now();
+    std::chrono::duration<double> time_used_for_query = std::chrono::duration_cast<std::chrono::duration<double>>(t_query_after - t_query_before);
+    cout << "Query processing time: " << time_used_for_query.count() << endl;
+
+    vector<Plaintext> pt(crtModulusNumber);
+    for (int q = 0; q < crtModulusNumber; q++) {
+        cc[q] -> Decrypt(keyPair[q].secretKey, X[q], &pt[q]);
+    }
+    int matches = 0, expected = 0;
+    for (int i = 0; i < tau; i++) {
+        bool match = true, expect = true;
+        for (int q = 0; q < crtModulusNumber; q++) {
+            match = match && pt[q] -> GetPackedValue()[i] == 1;
+        }
+        for (int j = 0; j < numEq; j++) {
+            expect = expect && column[j][i] == column[j][0];
+        }
+        matches += match;
+        expected += expect;
+    }
+    cout << "Matches: " << matches << ", expected: " << expected << endl;
+    return 0;
+}
+
+int64_t centered(int64_t val, int64_t modulus) {
+    val %= modulus;
+    if (val < 0) {
+        val += modulus;
+    }
+    return val > modulus / 2 ? val - modulus : val;
+}
+
+size_t serializedSize(const T_CP &ct) {
+    std::stringstream s;
+    Serial::Serialize(ct, s, SerType::BINARY);
+    return s.str().size();
+}
+
+// Keeps slot j of `compact` and sums over all slots, leaving the value of slot j in every slot.
+T_CP replicate(const T_CP &compact, int j, int q) {
+    vector<int64_t> oneHot(slots, 0);
+    oneHot[j] = 1;
+    auto masked = cc[q] -> EvalMult(compact, cc[q] -> MakePackedPlaintext(oneHot));
+    return cc[q] -> EvalSum(masked, slots);
+}
+
+// 1 - (op1 - op2)^(p-1), i.e. 1 in the slots where op1 equals op2 and 0 elsewhere.
+T_CP eqChain(const T_CP &op1, const T_CP &op2, int q) {
+    auto ct = cc[q] -> EvalSub(op1, op2);
+    T_CP res;
+    for (int64_t x = crtModulusVector[q] - 1; x > 0; x >>= 1)
+    {
+        if (x & 1)
+        {
+            res = res ? cc[q]->EvalMult(ct, res) : ct;
+        }
+        if (x > 1) {
+            ct = cc[q]->EvalMult(ct, ct);
+        }
+    }
+    vector<int64_t> ones(slots, 1);
+    return cc[q] -> EvalSub(cc[q] -> MakePackedPlaintext(ones), res);
+}
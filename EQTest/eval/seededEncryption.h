@@ -0,0 +1,84 @@
+#ifndef EDB_SEEDEDENCRYPTION_H
+#define EDB_SEEDEDENCRYPTION_H
+
+#include "openfhe.h"
+#include "ciphertext-ser.h"
+#include "utils/prng/blake2engine.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Seeded secret-key encryption, only usable by the data owner/querier who holds the secret key.
+// A symmetric ciphertext (c0, c1) decrypts as c0 + c1 * s, so c1 can be swapped for a = expand(seed)
+// by setting c0' = c0 + (c1 - a) * s. The wire form is the seed followed by the one element
+// ciphertext (c0'), about half the size of a public-key ciphertext.
+
+// Expands a PRG seed into the uniform polynomial `a` of a fresh ciphertext, tower by tower,
+// by rejection sampling so that client and server expand the same seed identically.
+inline lbcrypto::DCRTPoly expandSeed(const std::array<uint32_t, 16> &seed, const std::shared_ptr<lbcrypto::DCRTPoly::Params> &params) {
+    using namespace lbcrypto;
+    default_prng::Blake2Engine engine(seed);
+    DCRTPoly a(params, Format::EVALUATION, true);
+    for (size_t i = 0; i < params -> GetParams().size(); i++) {
+        auto towerParams = params -> GetParams()[i];
+        const uint64_t modulus = towerParams -> GetModulus().ConvertToInt();
+        const uint32_t bits = towerParams -> GetModulus().GetMSB();
+        const uint64_t mask = bits >= 64 ? UINT64_MAX : (uint64_t(1) << bits) - 1;
+        NativePoly tower(towerParams, Format::EVALUATION, true);
+        for (uint32_t j = 0; j < towerParams -> GetRingDimension(); j++) {
+            uint64_t r;
+            do {
+                r = ((uint64_t(engine()) << 32) | engine()) & mask;
+            } while (r >= modulus);
+            tower[j] = NativeInteger(r);
+        }
+        a.SetElementAtIndex(i, tower);
+    }
+    return a;
+}
+
+inline std::string seededEncrypt(const lbcrypto::CryptoContext<lbcrypto::DCRTPoly> &cc,
+                                 const lbcrypto::PrivateKey<lbcrypto::DCRTPoly> &secretKey,
+                                 const lbcrypto::Plaintext &pt) {
+    using namespace lbcrypto;
+    auto ct = cc -> Encrypt(secretKey, pt);
+
+    std::array<uint32_t, 16> seed;
+    std::random_device rd;
+    for (auto &w : seed) {
+        w = rd();
+    }
+
+    const DCRTPoly &s = secretKey -> GetPrivateElement();
+    const std::vector<DCRTPoly> &elements = ct -> GetElements();
+    DCRTPoly a = expandSeed(seed, elements[1].GetParams());
+    DCRTPoly c0 = elements[0] + (elements[1] - a) * s;
+    ct -> SetElements({c0});
+
+    std::string msg(sizeof(seed), '\0');
+    memcpy(&msg[0], seed.data(), sizeof(seed));
+    std::stringstream str;
+    Serial::Serialize(ct, str, SerType::BINARY);
+    return msg + str.str();
+}
+
+inline lbcrypto::Ciphertext<lbcrypto::DCRTPoly> seededExpand(const std::string &msg) {
+    using namespace lbcrypto;
+    std::array<uint32_t, 16> seed;
+    memcpy(seed.data(), msg.data(), sizeof(seed));
+    std::stringstream str(msg.substr(sizeof(seed)));
+    Ciphertext<DCRTPoly> ct;
+    Serial::Deserialize(ct, str, SerType::BINARY);
+
+    std::vector<DCRTPoly> elements = ct -> GetElements();
+    elements.push_back(expandSeed(seed, elements[0].GetParams()));
+    ct -> SetElements(elements);
+    return ct;
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef EDB_TASKGRAPH_H
+#define EDB_TASKGRAPH_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// A DAG of tasks with cost hints, run on a work-stealing pool.
+//
+// Every task carries an estimated cost (e.g. EvalMults of its chain). Its rank is the cost of
+// the longest path from the task to a sink, so ready tasks on long chains (large moduli) are
+// started first. Each worker owns a deque: successors made ready by a task go to the back of the
+// worker that finished it and are popped from there, LIFO, while they are still in cache. An idle
+// worker steals the front of the victim with the most queued cost. Independent branches of the
+// graph, e.g. aggregation and the query conditions, simply interleave.
+class TaskGraph {
+public:
+    int addTask(double cost, const std::function<void()> &fn, const std::vector<int> &deps = {}) {
+        const int id = tasks.size();
+        tasks.push_back({fn, cost, 0.0, (int) deps.size(), {}});
+        for (int d : deps) {
+            tasks[d].successors.push_back(id);
+        }
+        return id;
+    }
+
+    size_t size() const {
+        return tasks.size();
+    }
+
+    // Runs every task on `threads` workers, each with an OpenMP team of `innerThreads`.
+    void run(int threads, int innerThreads) {
+        const int n = tasks.size();
+        computeRanks();
+        workers = std::vector<Worker>(threads);
+        pending = std::vector<std::atomic<int>>(n);
+        for (int t = 0; t < n; t++) {
+            pending[t] = tasks[t].deps;
+        }
+        remaining = n;
+        steals = 0;
+
+        std::vector<int> ready;
+        for (int t = 0; t < n; t++) {
+            if (tasks[t].deps == 0) {
+                ready.push_back(t);
+            }
+        }
+        // Highest rank last, so owners pop it first.
+        std::sort(ready.begin(), ready.end(), [&](int a, int b) { return tasks[a].rank < tasks[b].rank; });
+        for (size_t k = 0; k < ready.size(); k++) {
+            push(k % threads, ready[k]);
+        }
+
+        std::vector<std::thread> pool;
+        for (int w = 0; w < threads; w++) {
+            pool.emplace_back([this, w, innerThreads]() {
+#ifdef _OPENMP
+                omp_set_num_threads(innerThreads);
+#else
+                (void) innerThreads;
+#endif
+                work(w);
+            });
+        }
+        for (auto &t : pool) {
+            t.join();
+        }
+    }
+
+    void report(double wallTime) const {
+        double total = 0.0;
+        for (const auto &t : tasks) {
+            total += t.cost;
+        }
+        double busy = 0.0;
+        for (const auto &w : workers) {
+            busy += w.busyTime;
+        }
+        std::cout << "Task graph: " << tasks.size() << " tasks, total cost " << total << ", critical path " << criticalPath
+                  << ", " << steals << " steals, worker utilization " << (wallTime > 0 ? busy / (wallTime * workers.size()) : 0.0)
+                  << std::endl;
+    }
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        double cost;
+        double rank;
+        int deps;
+        std::vector<int> successors;
+    };
+
+    struct Worker {
+        std::mutex lock;
+        std::deque<int> queue;
+        std::atomic<double> queuedCost{0.0};   // read by thieves without the lock
+        double busyTime = 0.0;
+    };
+
+    std::vector<Task> tasks;
+    std::vector<Worker> workers;
+    std::vector<std::atomic<int>> pending;
+    std::atomic<int> remaining;
+    std::atomic<int> steals;
+    double criticalPath = 0.0;
+
+    // Tasks are added after their dependencies, so a reverse sweep sees every successor first.
+    void computeRanks() {
+        criticalPath = 0.0;
+        for (int t = tasks.size() - 1; t >= 0; t--) {
+            double longest = 0.0;
+            for (int s : tasks[t].successors) {
+                longest = std::max(longest, tasks[s].rank);
+            }
+            tasks[t].rank = tasks[t].cost + longest;
+            criticalPath = std::max(criticalPath, tasks[t].rank);
+        }
+    }
+
+    void push(int w, int t) {
+        std::lock_guard<std::mutex> guard(workers[w].lock);
+        workers[w].queue.push_back(t);
+        workers[w].queuedCost = workers[w].queuedCost + tasks[t].cost;
+    }
+
+    bool popOwn(int w, int &t) {
+        std::lock_guard<std::mutex> guard(workers[w].lock);
+        if (workers[w].queue.empty()) {
+            return false;
+        }
+        t = workers[w].queue.back();
+        workers[w].queue.pop_back();
+        workers[w].queuedCost = workers[w].queuedCost - tasks[t].cost;
+        return true;
+    }
+
+    bool steal(int w, int &t) {
+        int victim = -1;
+        double most = 0.0;
+        for (size_t v = 0; v < workers.size(); v++) {
+            if ((int) v != w && workers[v].queuedCost > most) {
+                most = workers[v].queuedCost;
+                victim = v;
+            }
+        }
+        if (victim < 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> guard(workers[victim].lock);
+        if (workers[victim].queue.empty()) {
+            return false;
+        }
+        t = workers[victim].queue.front();
+        workers[victim].queue.pop_front();
+        workers[victim].queuedCost = workers[victim].queuedCost - tasks[t].cost;
+        steals++;
+        return true;
+    }
+
+    void work(int w) {
+        while (remaining > 0) {
+            int t;
+            if (!popOwn(w, t) && !steal(w, t)) {
+                std::this_thread::yield();
+                continue;
+            }
+            std::chrono::steady_clock::time_point t_before = std::chrono::steady_clock::now();
+            tasks[t].fn();
+            std::chrono::duration<double> time_used = std::chrono::steady_clock::now() - t_before;
+            workers[w].busyTime += time_used.count();
+            for (int s : tasks[t].successors) {
+                if (--pending[s] == 0) {
+                    push(w, s);
+                }
+            }
+            remaining--;
+        }
+    }
+};
+
+#endif
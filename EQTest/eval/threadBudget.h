@@ -0,0 +1,174 @@
+#ifndef EDB_THREADBUDGET_H
+#define EDB_THREADBUDGET_H
+
+#include "openfhe.h"
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Splits the cores between outer tasks (records x moduli) and OpenFHE's own OpenMP loops over the
+// RNS towers inside every EvalMult, so the two levels never oversubscribe the machine.
+//
+// A loop of `tasks` independent tasks runs on `outer` threads, and each thread caps its OpenMP
+// team at cores / outer. Without a profile, outer = min(tasks, cores): a query of a few records
+// runs wide inside each EvalMult, and a large scan runs one task per core. `tune` measures every
+// power-of-two split on a calibration workload and stores the fastest split per task count in a
+// per-machine profile, threadBudget-<hostname>.txt, which `auto` then uses. `cores` is the
+// affinity mask of the calling thread, so a loop on a thread pinned to one NUMA node stays on
+// that node's cores.
+class ThreadBudget {
+public:
+    using T_CP = lbcrypto::Ciphertext<lbcrypto::DCRTPoly>;
+
+    std::string profilePath;
+    std::map<std::pair<int, int>, int> profile;   // (cores, tasks) -> outer threads
+    bool tuning;
+
+    ThreadBudget(const std::string &profilePath, bool tuning) : profilePath(profilePath), tuning(tuning) {
+        std::ifstream f(profilePath);
+        int cores, tasks, outer;
+        while (f >> cores >> tasks >> outer) {
+            profile[{cores, tasks}] = outer;
+        }
+    }
+
+    // Reads `none`, `auto` (use the tuned profile of this machine when there is one) or `tune`.
+    static ThreadBudget *fromInput(std::istream &in) {
+        std::string mode;
+        in >> mode;
+        if (mode != "auto" && mode != "tune") {
+            return nullptr;
+        }
+        char host[256] = "localhost";
+        gethostname(host, sizeof(host) - 1);
+        return new ThreadBudget(std::string("threadBudget-") + host + ".txt", mode == "tune");
+    }
+
+    static int currentCores() {
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+            return std::max(1u, std::thread::hardware_concurrency());
+        }
+        return std::max(1, CPU_COUNT(&set));
+    }
+
+    // Outer threads for `tasks` tasks: the profile entry of the largest tuned task count not above
+    // `tasks`, or min(tasks, cores).
+    int outerWidth(int tasks, int cores) const {
+        int outer = std::min(tasks, cores);
+        for (const auto &entry : profile) {
+            if (entry.first.first == cores && entry.first.second <= tasks) {
+                outer = entry.second;
+            }
+        }
+        return std::max(1, std::min(outer, std::max(tasks, 1)));
+    }
+
+    void parallelFor(int tasks, const std::function<void(int)> &fn) {
+        const int cores = currentCores();
+        run(tasks, outerWidth(tasks, cores), cores, fn);
+    }
+
+    // Times every power-of-two split for 1, 2, 4, ... up to 4 * cores tasks of `rounds` squarings
+    // of a fresh ciphertext under `cc`, and writes the fastest split of each to the profile.
+    void tune(const lbcrypto::CryptoContext<lbcrypto::DCRTPoly> &cc, const lbcrypto::PublicKey<lbcrypto::DCRTPoly> &pk, int rounds) {
+        const int cores = currentCores();
+        std::vector<int64_t> one = {1};
+        lbcrypto::Plaintext pt = cc -> MakeCoefPackedPlaintext(one);
+        const T_CP seed = cc -> Encrypt(pk, pt);
+        auto task = [&](int) {
+            T_CP ct = seed;
+            for (int r = 0; r < rounds; r++) {
+                ct = cc -> EvalMult(ct, ct);
+            }
+        };
+
+        std::cout << "Thread budget tuning on " << cores << " cores:" << std::endl << "tasks\touter\tinner\ttime" << std::endl;
+        for (int tasks = 1; tasks <= 4 * cores; tasks *= 2) {
+            int best = 1;
+            double bestTime = 0.0;
+            for (int outer = 1; outer <= std::min(tasks, cores); outer *= 2) {
+                std::chrono::steady_clock::time_point t_before = std::chrono::steady_clock::now();
+                run(tasks, outer, cores, task);
+                std::chrono::duration<double> time_used = std::chrono::steady_clock::now() - t_before;
+                std::cout << tasks << "\t" << outer << "\t" << cores / outer << "\t" << time_used.count() << std::endl;
+                if (outer == 1 || time_used.count() < bestTime) {
+                    best = outer;
+                    bestTime = time_used.count();
+                }
+            }
+            profile[{cores, tasks}] = best;
+        }
+
+        std::ofstream f(profilePath);
+        for (const auto &entry : profile) {
+            f << entry.first.first << " " << entry.first.second << " " << entry.second << std::endl;
+        }
+        std::cout << "Thread budget profile written to " << profilePath << std::endl;
+    }
+
+    void report(int tasks) const {
+        const int cores = currentCores();
+        const int outer = outerWidth(tasks, cores);
+        std::cout << "Thread budget for " << tasks << " tasks on " << cores << " cores: " << outer << " outer x "
+                  << std::max(1, cores / outer) << " inner" << std::endl;
+    }
+
+private:
+    static void run(int tasks, int outer, int cores, const std::function<void(int)> &fn) {
+        std::atomic<int> next(0);
+        auto worker = [&]() {
+#ifdef _OPENMP
+            omp_set_num_threads(std::max(1, cores / outer));
+#else
+            (void) cores;
+#endif
+            for (int t = next++; t < tasks; t = next++) {
+                fn(t);
+            }
+        };
+#ifdef _OPENMP
+        const int saved = omp_get_max_threads();
+#endif
+        std::vector<std::thread> threads;
+        for (int k = 1; k < outer; k++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &t : threads) {
+            t.join();
+        }
+#ifdef _OPENMP
+        omp_set_num_threads(saved);
+#endif
+    }
+};
+
+// Serial when no budget is given.
+inline void parallelFor(ThreadBudget *budget, int tasks, const std::function<void(int)> &fn) {
+    if (budget) {
+        budget -> parallelFor(tasks, fn);
+        return;
+    }
+    for (int t = 0; t < tasks; t++) {
+        fn(t);
+    }
+}
+
+#endif